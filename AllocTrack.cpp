@@ -0,0 +1,216 @@
+#include "AllocTrack.h"
+#include <algorithm>
+
+#ifdef BCG_ALLOC_TRACK
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define BCG_ALLOC_HOOK_MALLOC
+#elif defined(Q_OS_MACOS)
+#include <malloc/malloc.h>
+#define BCG_ALLOC_HOOK_NEW
+#endif
+
+namespace AllocTrack
+{
+    namespace {
+        // Plain statics only: these are touched from inside malloc, before and after main(),
+        // so nothing here may need a constructor or allocate.
+        struct Slot
+        {
+            std::atomic<quint64> allocs, frees, bytes;
+            std::atomic<qint64> peakLive;
+        };
+        Slot slots[NSlots];
+        std::atomic<qint64> live;
+        thread_local int current = Untagged;
+
+        inline void raise(std::atomic<qint64> & peak, qint64 v)
+        {
+            qint64 p = peak.load(std::memory_order_relaxed);
+            while (v > p && !peak.compare_exchange_weak(p, v, std::memory_order_relaxed)) {}
+        }
+
+        inline void onAlloc(size_t n)
+        {
+            Slot & s = slots[current];
+            s.allocs.fetch_add(1, std::memory_order_relaxed);
+            s.bytes.fetch_add(n, std::memory_order_relaxed);
+            raise(s.peakLive, live.fetch_add(qint64(n), std::memory_order_relaxed) + qint64(n));
+        }
+
+        inline void onFree(size_t n)
+        {
+            slots[current].frees.fetch_add(1, std::memory_order_relaxed);
+            live.fetch_sub(qint64(n), std::memory_order_relaxed);
+        }
+    }
+
+    bool enabled()
+    {
+#if defined(BCG_ALLOC_HOOK_MALLOC) || defined(BCG_ALLOC_HOOK_NEW)
+        return true;
+#else
+        return false; // no hooks for this platform
+#endif
+    }
+
+    int setSlot(int slot)
+    {
+        const int prev = current;
+        current = slot >= 0 && slot < NSlots ? slot : Untagged;
+        return prev;
+    }
+}
+
+#ifdef BCG_ALLOC_HOOK_MALLOC
+extern "C" {
+    void *__libc_malloc(size_t);
+    void *__libc_calloc(size_t, size_t);
+    void *__libc_realloc(void *, size_t);
+    void *__libc_memalign(size_t, size_t);
+    void *__libc_valloc(size_t);
+    void *__libc_pvalloc(size_t);
+    void __libc_free(void *);
+
+    void *malloc(size_t n)
+    {
+        void *p = __libc_malloc(n);
+        if (p) AllocTrack::onAlloc(malloc_usable_size(p));
+        return p;
+    }
+
+    void *calloc(size_t n, size_t sz)
+    {
+        void *p = __libc_calloc(n, sz);
+        if (p) AllocTrack::onAlloc(malloc_usable_size(p));
+        return p;
+    }
+
+    void *realloc(void *p, size_t n)
+    {
+        const size_t old = p ? malloc_usable_size(p) : 0;
+        void *q = __libc_realloc(p, n);
+        if (q) {
+            if (p) AllocTrack::onFree(old);
+            AllocTrack::onAlloc(malloc_usable_size(q));
+        } else if (p && !n) {
+            AllocTrack::onFree(old); // realloc(p, 0) freed p
+        }
+        return q;
+    }
+
+    // The aligned allocators too: their blocks come back through free() like any other, and
+    // libstdc++'s aligned operator new is built on them.
+    void *memalign(size_t align, size_t n)
+    {
+        void *p = __libc_memalign(align, n);
+        if (p) AllocTrack::onAlloc(malloc_usable_size(p));
+        return p;
+    }
+
+    void *aligned_alloc(size_t align, size_t n) { return memalign(align, n); }
+
+    int posix_memalign(void **out, size_t align, size_t n)
+    {
+        if (!align || (align & (align - 1)) || align % sizeof(void *)) return EINVAL;
+        void *p = memalign(align, n);
+        if (!p) return ENOMEM;
+        *out = p;
+        return 0;
+    }
+
+    void *valloc(size_t n)
+    {
+        void *p = __libc_valloc(n);
+        if (p) AllocTrack::onAlloc(malloc_usable_size(p));
+        return p;
+    }
+
+    void *pvalloc(size_t n)
+    {
+        void *p = __libc_pvalloc(n);
+        if (p) AllocTrack::onAlloc(malloc_usable_size(p));
+        return p;
+    }
+
+    void free(void *p)
+    {
+        if (!p) return;
+        AllocTrack::onFree(malloc_usable_size(p));
+        __libc_free(p);
+    }
+}
+#endif
+
+#ifdef BCG_ALLOC_HOOK_NEW
+void *operator new(size_t n)
+{
+    void *p = std::malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    AllocTrack::onAlloc(malloc_size(p));
+    return p;
+}
+void *operator new[](size_t n) { return ::operator new(n); }
+void *operator new(size_t n, const std::nothrow_t &) noexcept
+{
+    void *p = std::malloc(n ? n : 1);
+    if (p) AllocTrack::onAlloc(malloc_size(p));
+    return p;
+}
+void *operator new[](size_t n, const std::nothrow_t & t) noexcept { return ::operator new(n, t); }
+void operator delete(void *p) noexcept
+{
+    if (!p) return;
+    AllocTrack::onFree(malloc_size(p));
+    std::free(p);
+}
+void operator delete[](void *p) noexcept { ::operator delete(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { ::operator delete(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { ::operator delete(p); }
+#endif
+#endif // BCG_ALLOC_TRACK
+
+namespace AllocTrack
+{
+    Counters counters(int slot)
+    {
+        Counters c;
+#ifdef BCG_ALLOC_TRACK
+        if (slot < 0 || slot >= NSlots) return c;
+        const Slot & s = slots[slot];
+        c.allocs = s.allocs.load(std::memory_order_relaxed);
+        c.frees = s.frees.load(std::memory_order_relaxed);
+        c.bytes = s.bytes.load(std::memory_order_relaxed);
+        c.peakLive = s.peakLive.load(std::memory_order_relaxed);
+#else
+        Q_UNUSED(slot);
+#endif
+        return c;
+    }
+
+    Counters total()
+    {
+        Counters t;
+        for (int i = 0; i < NSlots; ++i) {
+            const Counters c = counters(i);
+            t.allocs += c.allocs;
+            t.frees += c.frees;
+            t.bytes += c.bytes;
+            t.peakLive = std::max(t.peakLive, c.peakLive);
+        }
+        return t;
+    }
+
+    qint64 liveBytes()
+    {
+#ifdef BCG_ALLOC_TRACK
+        return live.load(std::memory_order_relaxed);
+#else
+        return 0;
+#endif
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef ALLOCTRACK_H
+#define ALLOCTRACK_H
+
+#include <QtGlobal>
+
+/// Opt-in heap accounting (qmake CONFIG+=alloc_track, which defines BCG_ALLOC_TRACK).
+///
+/// Every allocation and free is charged to the calling thread's current slot; Perf::Scope
+/// switches the slot to its phase for its lifetime, so counts land on the pipeline phase
+/// that caused them. On glibc the malloc family is interposed, aligned allocators included
+/// (which also covers every operator new and Qt's QString/QByteArray buffers); on macOS the
+/// plain and nothrow operator new/delete are replaced.
+/// Bytes are usable allocation sizes, so frees can be accounted exactly. Without the define
+/// nothing is hooked and enabled() is false.
+namespace AllocTrack
+{
+    enum { MaxSlots = 15, Untagged = MaxSlots, NSlots };
+
+    struct Counters
+    {
+        quint64 allocs = 0, frees = 0, bytes = 0;
+        qint64 peakLive = 0; // highest process-wide live heap seen while allocating in this slot
+    };
+
+#ifdef BCG_ALLOC_TRACK
+    bool enabled();
+    int setSlot(int slot); // returns the previous slot of the calling thread
+#else
+    inline bool enabled() { return false; }
+    inline int setSlot(int) { return Untagged; }
+#endif
+
+    Counters counters(int slot);
+    Counters total();  // all slots together
+    qint64 liveBytes();
+}
+
+#endif // ALLOCTRACK_H
@@ -0,0 +1,47 @@
+#include "Arena.h"
+#include <algorithm>
+
+Arena::Arena(size_t chunkBytes)
+{
+    blocks.emplace_back(new char[chunkBytes]);
+    sizes.push_back(chunkBytes);
+    cur = blocks.back().get();
+    size = chunkBytes;
+}
+
+void *Arena::grow(size_t n, size_t align)
+{
+    usedBefore += used;
+    // a new chunk comes from operator new, so it is aligned for anything up to max_align_t
+    const size_t bytes = std::max(sizes.back() * 2, n + align);
+    blocks.emplace_back(new char[bytes]);
+    sizes.push_back(bytes);
+    cur = blocks.back().get();
+    size = bytes;
+    used = 0;
+    return allocate(n, align);
+}
+
+void Arena::reset()
+{
+    peak = std::max(peak, usedBefore + used);
+    if (blocks.size() > 1) {
+        // next time, all of it fits in one chunk
+        const size_t bytes = capacity();
+        blocks.clear();
+        sizes.clear();
+        blocks.emplace_back(new char[bytes]);
+        sizes.push_back(bytes);
+        cur = blocks.back().get();
+        size = bytes;
+    }
+    used = 0;
+    usedBefore = 0;
+}
+
+size_t Arena::capacity() const
+{
+    size_t n = 0;
+    for (size_t s : sizes) n += s;
+    return n;
+}
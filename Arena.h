@@ -0,0 +1,97 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <QtGlobal>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/// Monotonic (bump) allocator for short-lived data that all dies at once, such as the parse
+/// state of one page. allocate() just advances a pointer; nothing is freed individually, and
+/// reset() makes all of it available again. Only trivially destructible types may live here,
+/// since no destructors are run.
+///
+/// When a chunk runs out another, twice as large, is added. reset() merges the chunks into
+/// one big enough for the whole of what was used, so once the arena has seen its largest page
+/// it stays a single chunk: reset() is O(1) and allocation never reaches the heap.
+///
+/// Not thread-safe; use one arena per thread.
+class Arena
+{
+public:
+    explicit Arena(size_t chunkBytes = 64*1024);
+    Arena(const Arena &) = delete;
+    Arena & operator=(const Arena &) = delete;
+
+    /// align: a power of two, at most alignof(std::max_align_t).
+    void *allocate(size_t n, size_t align = alignof(std::max_align_t))
+    {
+        const size_t at = (used + align - 1) & ~(align - 1);
+        if (at + n > size) return grow(n, align);
+        used = at + n;
+        return cur + at;
+    }
+
+    /// n default-initialised Ts.
+    template <typename T> T *make(size_t n = 1)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        T *p = static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        for (size_t i = 0; i < n; ++i) new (p + i) T();
+        return p;
+    }
+
+    void reset();
+
+    size_t capacity() const;                   // bytes held in chunks
+    size_t highWater() const { return peak; }  // most bytes used between two resets
+    int chunks() const { return int(blocks.size()); }
+
+private:
+    void *grow(size_t n, size_t align);
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> sizes;
+    char *cur = nullptr;
+    size_t size = 0, used = 0;
+    size_t usedBefore = 0; // in the chunks before cur
+    size_t peak = 0;
+};
+
+/// Growable array of trivially copyable Ts in an Arena. Growing copies into a fresh allocation
+/// twice the size and abandons the old one to the arena.
+template <typename T>
+class ArenaList
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ArenaList moves its elements with memcpy");
+public:
+    explicit ArenaList(Arena & a, int reserve = 16) : arena(a), cap(std::max(reserve, 1)) { data = arena.make<T>(size_t(cap)); }
+
+    T & append()
+    {
+        if (n == cap) {
+            T *bigger = arena.make<T>(size_t(cap) * 2);
+            std::memcpy(static_cast<void*>(bigger), data, size_t(n) * sizeof(T));
+            data = bigger;
+            cap *= 2;
+        }
+        return data[n++];
+    }
+    void clear() { n = 0; }
+    int size() const { return n; }
+    T & operator[](int i) { return data[i]; }
+    const T & operator[](int i) const { return data[i]; }
+    const T *begin() const { return data; }
+    const T *end() const { return data + n; }
+
+private:
+    Arena & arena;
+    T *data;
+    int n = 0, cap;
+};
+
+#endif // ARENA_H
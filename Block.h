@@ -0,0 +1,21 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <QString>
+#include <QMap>
+#include <QVector>
+
+struct Block
+{
+    Block() : height(0), time(0) {}
+    Block(unsigned h, const QString &hh, qint64 t) : height(h), hash(hh), time(t) {}
+    unsigned height;
+    QString hash;
+    qint64 time;
+};
+
+typedef QMap<unsigned, Block> BlockMap;
+typedef QMap<qint64, Block> BlockTimeMap;
+typedef QVector<Block> BlockList;
+
+#endif // BLOCK_H
@@ -5,18 +5,62 @@
 TEMPLATE = app
 TARGET = BlockChainGrok
 INCLUDEPATH += .
-CONFIG += console c++11 core
-QT += network
+include(common.pri)
+LIBS += -lz # Inflate.cpp
 
 # Input
-SOURCES += main.cpp
-
-
-macx {
-    CONFIG -= app_bundle
-    QMAKE_CXXFLAGS += -Wno-format-nonliteral -Wno-format -Wno-format-security
-}
-
-linux {
-    QMAKE_CXXFLAGS += -Wno-format-nonliteral -Wno-format -Wno-format-security
-}
+HEADERS += Log.h \
+           Block.h \
+           Arena.h \
+           BlockParser.h \
+           BlockStore.h \
+           Stats.h \
+           Csv.h \
+           WaveletTree.h \
+           TimeColumn.h \
+           TimeIndex.h \
+           Perf.h \
+           Trace.h \
+           AllocTrack.h \
+           HttpServer.h \
+           MockServer.h \
+           Inflate.h \
+           BufferPool.h \
+           HttpClient.h \
+           Fetcher.h \
+           BlockFile.h \
+           Checkpoint.h \
+           FetchPlanner.h \
+           QueryServer.h \
+           MetricsServer.h \
+           Notifier.h \
+           SpscQueue.h \
+           Pipeline.h \
+           TaskPool.h \
+           Coro.h
+SOURCES += main.cpp \
+           Log.cpp \
+           Arena.cpp \
+           BlockParser.cpp \
+           BlockStore.cpp \
+           Stats.cpp \
+           Csv.cpp \
+           WaveletTree.cpp \
+           TimeColumn.cpp \
+           TimeIndex.cpp \
+           Perf.cpp \
+           Trace.cpp \
+           AllocTrack.cpp \
+           HttpServer.cpp \
+           MockServer.cpp \
+           Inflate.cpp \
+           HttpClient.cpp \
+           Fetcher.cpp \
+           BlockFile.cpp \
+           Checkpoint.cpp \
+           FetchPlanner.cpp \
+           QueryServer.cpp \
+           MetricsServer.cpp \
+           Notifier.cpp \
+           Pipeline.cpp \
+           TaskPool.cpp
@@ -0,0 +1,56 @@
+#include "BlockFile.h"
+#include <QtEndian>
+#include <cstring>
+
+namespace BlockFile
+{
+    namespace {
+        const char Magic[8] = { 'B','C','G','B','L','K','S','1' };
+    }
+
+    void encodeHeader(quint64 count, char *out)
+    {
+        std::memcpy(out, Magic, 8);
+        qToLittleEndian<quint32>(Version, out + 8);
+        qToLittleEndian<quint32>(0, out + 12);
+        qToLittleEndian<quint64>(count, out + 16);
+    }
+
+    bool decodeHeader(const char *in, quint64 *count)
+    {
+        if (std::memcmp(in, Magic, 8) || qFromLittleEndian<quint32>(in + 8) != Version)
+            return false;
+        if (count) *count = qFromLittleEndian<quint64>(in + 16);
+        return true;
+    }
+
+    void encode(const Record & r, char *out)
+    {
+        qToLittleEndian<quint32>(r.height, out);
+        qToLittleEndian<quint32>(r.flags, out + 4);
+        qToLittleEndian<qint64>(r.time, out + 8);
+        std::memcpy(out + 16, r.hash, 32);
+    }
+
+    void decode(const char *in, Record & r)
+    {
+        r.height = qFromLittleEndian<quint32>(in);
+        r.flags = qFromLittleEndian<quint32>(in + 4);
+        r.time = qFromLittleEndian<qint64>(in + 8);
+        std::memcpy(r.hash, in + 16, 32);
+    }
+
+    bool setHash(Record & r, const QByteArray & hex)
+    {
+        if (hex.size() != 64) return false;
+        const QByteArray raw = QByteArray::fromHex(hex);
+        if (raw.size() != 32) return false;
+        std::memcpy(r.hash, raw.constData(), 32);
+        return true;
+    }
+
+    QByteArray hashHex(const Record & r)
+    {
+        return QByteArray(reinterpret_cast<const char *>(r.hash), 32).toHex();
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef BLOCKFILE_H
+#define BLOCKFILE_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+/// Binary block store: a fixed header followed by fixed-size little-endian records, so
+/// writers can fill disjoint record ranges in parallel and readers can seek straight to record i.
+///
+///     header:  "BCGBLKS1" | quint32 version | quint32 reserved | quint64 record count
+///     record:  quint32 height | quint32 flags | qint64 time | 32-byte hash (raw, display order)
+namespace BlockFile
+{
+    enum { HeaderSize = 24, RecordSize = 48, Version = 1 };
+    enum Flags {
+        MainChain = 1,
+        HeightIndexed = 2,  // checkpoints: the block is BlockStore::byHeight()'s entry for its height
+        TimeIndexed = 4     // checkpoints: ... and/or byTime()'s entry for its timestamp
+    };
+
+    struct Record
+    {
+        quint32 height = 0;
+        quint32 flags = MainChain;
+        qint64 time = 0;
+        quint8 hash[32] = {};
+    };
+
+    void encodeHeader(quint64 count, char *out);
+    bool decodeHeader(const char *in, quint64 *count); // false on bad magic or version
+    void encode(const Record & r, char *out);
+    void decode(const char *in, Record & r);
+
+    bool setHash(Record & r, const QByteArray & hex); // false unless hex is 64 hex digits
+    QByteArray hashHex(const Record & r);
+}
+
+#endif // BLOCKFILE_H
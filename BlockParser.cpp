@@ -0,0 +1,444 @@
+#include "BlockParser.h"
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QJsonValue>
+#include <QVariant>
+#include <QLatin1String>
+#include <QByteArray>
+#include <QtNumeric>
+#include <cctype>
+#include <cstring>
+#include "Arena.h"
+
+namespace BlockParser
+{
+    namespace {
+        bool fail(QString *err, const char *msg)
+        {
+            if (err) *err = msg;
+            return false;
+        }
+
+        // parsePage's handle on a string: into the page, or into the arena if it had escapes
+        struct StrView
+        {
+            const char *p;
+            int n;
+            bool is(const char *s) const { return int(std::strlen(s)) == n && !std::memcmp(p, s, size_t(n)); }
+        };
+
+        // Length of the well-formed UTF-8 sequence at p (lead byte >= 0x80), or 0. Overlong forms,
+        // surrogates and code points past U+10FFFF are ill-formed, as QJsonDocument has it.
+        int utf8Length(const char *p, const char *end)
+        {
+            const unsigned char *s = reinterpret_cast<const unsigned char *>(p);
+            const unsigned char c = s[0];
+            unsigned char lo = 0x80, hi = 0xbf; // range of the second byte
+            int n;
+            if (c >= 0xc2 && c <= 0xdf) {
+                n = 2;
+            } else if (c >= 0xe0 && c <= 0xef) {
+                n = 3;
+                if (c == 0xe0) lo = 0xa0;
+                else if (c == 0xed) hi = 0x9f;
+            } else if (c >= 0xf0 && c <= 0xf4) {
+                n = 4;
+                if (c == 0xf0) lo = 0x90;
+                else if (c == 0xf4) hi = 0x8f;
+            } else {
+                return 0;
+            }
+            if (end - p < n || s[1] < lo || s[1] > hi) return 0;
+            for (int i = 2; i < n; ++i)
+                if ((s[i] & 0xc0) != 0x80) return 0;
+            return n;
+        }
+
+        // one element of the blocks array, as far as parsePage cares
+        struct BlockRec
+        {
+            StrView hash;
+            double height, time;
+            bool object, empty, main, hasHeight, hasTime;
+        };
+
+        // Recursive descent over the page's bytes. Everything but the top-level "blocks" array is
+        // only checked for well-formedness and skipped; its elements become BlockRecs. It may
+        // reject JSON that QJsonDocument would take (it is strict RFC 8259, where Qt lets unknown
+        // escapes, control characters and a BOM through), but never the other way round.
+        class Scanner
+        {
+        public:
+            Scanner(const QByteArray & page, Arena & a)
+                : begin(page.constData()), p(begin), end(begin + page.size()), arena(a),
+                  blocks(a, std::max(16, page.size() / 96)) {} // a page's blocks take ~100 bytes each
+
+            bool document(); // false if the page isn't JSON, or not JSON the scanner vouches for
+
+            bool isObject = false;
+            bool loneSurrogate = false; // decoded a \uXXXX surrogate with no partner
+            bool sawBlocks = false; // a "blocks" array at the top level
+            ArenaList<BlockRec> & records() { return blocks; }
+
+        private:
+            enum { MaxDepth = 1024 }; // nested arrays/objects, as QJsonDocument
+
+            char peek() const { return p < end ? *p : '\0'; } // NUL is never valid outside a string
+            void ws() { while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p; }
+            bool string(StrView & out, bool decode);
+            bool number(double & v);
+            bool literal(const char *word);
+            bool value(int depth);
+            bool blocksArray();
+            bool block(BlockRec & r);
+
+            const char *begin, *p, *end;
+            Arena & arena;
+            ArenaList<BlockRec> blocks;
+        };
+
+        bool Scanner::document()
+        {
+            ws();
+            if (peek() == '{') {
+                isObject = true;
+                ++p;
+                ws();
+                if (peek() == '}') {
+                    ++p;
+                } else {
+                    for (;;) {
+                        StrView key;
+                        if (!string(key, true)) return false;
+                        ws();
+                        if (peek() != ':') return false;
+                        ++p;
+                        ws();
+                        if (!(key.is("blocks") ? blocksArray() : value(1))) return false;
+                        ws();
+                        if (peek() == ',') { ++p; ws(); continue; }
+                        if (peek() == '}') { ++p; break; }
+                        return false;
+                    }
+                }
+            } else if (peek() == '[') {
+                if (!value(0)) return false; // well-formed, but not a page
+            } else {
+                return false; // not an object or array
+            }
+            ws();
+            return p == end; // else garbage after the document
+        }
+
+        bool Scanner::blocksArray()
+        {
+            // the last "blocks" wins, as with QJsonObject
+            blocks.clear();
+            sawBlocks = peek() == '[';
+            if (!sawBlocks) return value(1);
+            ++p;
+            ws();
+            if (peek() == ']') {
+                ++p;
+                return true;
+            }
+            for (;;) {
+                BlockRec & r = blocks.append();
+                r = BlockRec();
+                if (!(peek() == '{' ? block(r) : value(2))) return false;
+                ws();
+                if (peek() == ',') { ++p; ws(); continue; }
+                if (peek() == ']') { ++p; return true; }
+                return false;
+            }
+        }
+
+        bool Scanner::block(BlockRec & r)
+        {
+            r.object = r.empty = true;
+            ++p;
+            ws();
+            if (peek() == '}') {
+                ++p;
+                return true;
+            }
+            for (;;) {
+                StrView key;
+                if (!string(key, true)) return false;
+                r.empty = false;
+                ws();
+                if (peek() != ':') return false;
+                ++p;
+                ws();
+                const char c = peek();
+                const bool num = c == '-' || (c >= '0' && c <= '9');
+                bool ok;
+                if (key.is("height")) {
+                    ok = (r.hasHeight = num) ? number(r.height) : value(3);
+                } else if (key.is("time")) {
+                    ok = (r.hasTime = num) ? number(r.time) : value(3);
+                } else if (key.is("hash")) {
+                    r.hash = StrView{nullptr, 0};
+                    ok = c == '"' ? string(r.hash, true) : value(3);
+                } else if (key.is("main_chain")) {
+                    r.main = c == 't';
+                    ok = value(3);
+                } else {
+                    ok = value(3);
+                }
+                if (!ok) return false;
+                ws();
+                if (peek() == ',') { ++p; ws(); continue; }
+                if (peek() == '}') { ++p; return true; }
+                return false;
+            }
+        }
+
+        bool Scanner::value(int depth)
+        {
+            const char c = peek();
+            if (c == '{' || c == '[') {
+                if (depth + 1 > MaxDepth) return false; // the page itself is level 1
+                const char close = c == '{' ? '}' : ']';
+                ++p;
+                ws();
+                if (peek() == close) {
+                    ++p;
+                    return true;
+                }
+                for (;;) {
+                    if (c == '{') {
+                        StrView key;
+                        if (!string(key, false)) return false;
+                        ws();
+                        if (peek() != ':') return false;
+                        ++p;
+                        ws();
+                    }
+                    if (!value(depth + 1)) return false;
+                    ws();
+                    if (peek() == ',') { ++p; ws(); continue; }
+                    if (peek() == close) { ++p; return true; }
+                    return false;
+                }
+            }
+            if (c == '"') {
+                StrView s;
+                return string(s, false);
+            }
+            if (c == 't') return literal("true");
+            if (c == 'f') return literal("false");
+            if (c == 'n') return literal("null");
+            double v;
+            return number(v);
+        }
+
+        bool Scanner::literal(const char *word)
+        {
+            const size_t n = std::strlen(word);
+            if (size_t(end - p) < n || std::memcmp(p, word, n)) return false;
+            p += n;
+            return true;
+        }
+
+        bool Scanner::number(double & v)
+        {
+            const char *start = p;
+            auto digits = [this]{
+                const char *d = p;
+                while (p < end && *p >= '0' && *p <= '9') ++p;
+                return int(p - d);
+            };
+            const bool neg = peek() == '-';
+            if (neg) ++p;
+            const int intDigits = digits();
+            if (!intDigits || (intDigits > 1 && start[neg] == '0')) return false; // no digits, or a leading zero
+            bool integer = true;
+            if (peek() == '.') {
+                ++p;
+                if (!digits()) return false;
+                integer = false;
+            }
+            if (peek() == 'e' || peek() == 'E') {
+                ++p;
+                if (peek() == '+' || peek() == '-') ++p;
+                if (!digits()) return false;
+                integer = false;
+            }
+            if (integer && intDigits <= 18) { // the usual case, and exact
+                quint64 x = 0;
+                for (const char *d = start + neg; d < p; ++d) x = x*10 + quint64(*d - '0');
+                v = neg ? -double(x) : double(x);
+            } else {
+                bool ok;
+                v = QByteArray::fromRawData(start, int(p - start)).toDouble(&ok); // locale-independent, unlike strtod
+                if (!ok || !qIsFinite(v)) return false; // out of range
+            }
+            return true;
+        }
+
+        // With decode, out holds the string's contents, unescaped into the arena if need be;
+        // otherwise the string is only checked and skipped.
+        bool Scanner::string(StrView & out, bool decode)
+        {
+            if (peek() != '"') return false;
+            const char *start = ++p;
+            bool escaped = false;
+            for (;;) {
+                if (p == end) return false;
+                const unsigned char c = static_cast<unsigned char>(*p);
+                if (c == '"') break;
+                if (c < 0x20) return false; // control character
+                if (c >= 0x80) {
+                    const int n = utf8Length(p, end);
+                    if (!n) return false;
+                    p += n;
+                    continue;
+                }
+                if (c == '\\') {
+                    escaped = true;
+                    if (++p == end) return false;
+                    if (*p == 'u') {
+                        for (int i = 0; i < 4; ++i)
+                            if (++p == end || !std::isxdigit(static_cast<unsigned char>(*p))) return false;
+                    } else if (!std::strchr("\"\\/bfnrt", *p) || !*p) {
+                        return false; // illegal escape
+                    }
+                }
+                ++p;
+            }
+            const char *stop = p++;
+            if (!decode) return true;
+            if (!escaped) {
+                out = StrView{start, int(stop - start)};
+                return true;
+            }
+            // unescaping never lengthens a string, so its raw length is enough room
+            char *buf = static_cast<char*>(arena.allocate(size_t(stop - start), 1)), *o = buf;
+            auto hex4 = [](const char *h) {
+                uint u = 0;
+                for (int i = 0; i < 4; ++i) {
+                    const char c = h[i];
+                    u = u*16 + uint(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+                }
+                return u;
+            };
+            for (const char *s = start; s < stop; ++s) {
+                if (*s != '\\') {
+                    *o++ = *s;
+                    continue;
+                }
+                switch (*++s) {
+                case 'b': *o++ = '\b'; break;
+                case 'f': *o++ = '\f'; break;
+                case 'n': *o++ = '\n'; break;
+                case 'r': *o++ = '\r'; break;
+                case 't': *o++ = '\t'; break;
+                case 'u': {
+                    uint u = hex4(s + 1);
+                    s += 4;
+                    if (u >= 0xd800 && u < 0xdc00 && stop - s > 6 && s[1] == '\\' && s[2] == 'u') {
+                        const uint lo = hex4(s + 3);
+                        if (lo >= 0xdc00 && lo < 0xe000) {
+                            u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+                            s += 6;
+                        }
+                    }
+                    if (u >= 0xd800 && u < 0xe000) { // unpaired, which QString keeps as is but UTF-8 can't
+                        loneSurrogate = true;
+                        u = 0xfffd;
+                    }
+                    if (u < 0x80) {
+                        *o++ = char(u);
+                    } else if (u < 0x800) {
+                        *o++ = char(0xc0 | (u >> 6));
+                        *o++ = char(0x80 | (u & 0x3f));
+                    } else if (u < 0x10000) {
+                        *o++ = char(0xe0 | (u >> 12));
+                        *o++ = char(0x80 | ((u >> 6) & 0x3f));
+                        *o++ = char(0x80 | (u & 0x3f));
+                    } else {
+                        *o++ = char(0xf0 | (u >> 18));
+                        *o++ = char(0x80 | ((u >> 12) & 0x3f));
+                        *o++ = char(0x80 | ((u >> 6) & 0x3f));
+                        *o++ = char(0x80 | (u & 0x3f));
+                    }
+                    break;
+                }
+                default: *o++ = *s; break; // " \ /
+                }
+            }
+            out = StrView{buf, int(o - buf)};
+            return true;
+        }
+    }
+
+    bool parseVariant(const QJsonDocument & d, BlockList & out, QString *err)
+    {
+        if (!d.isObject()) return fail(err, "Unknown Json type");
+        QVariantMap vm = d.object().toVariantMap();
+        QList<QVariant> vl;
+        if (!vm.contains("blocks") || (vl=vm["blocks"].toList()).isEmpty())
+            return fail(err, "Blocks array not found");
+        out.reserve(out.size() + vl.size());
+        for (const QVariant & v : vl) {
+            vm = v.toMap();
+            if (vm.isEmpty()) return fail(err, "variantMap is empty");
+            Block b;
+            bool ok1, ok2;
+            b.height = vm["height"].toUInt(&ok1);
+            b.hash = vm["hash"].toString();
+            b.time = vm["time"].toLongLong(&ok2);
+            bool main = vm["main_chain"].toBool();
+            if (!main) continue;
+            if (!ok1 || !ok2) return fail(err, "Parse error");
+            out.append(b);
+        }
+        return true;
+    }
+
+    bool parseJson(const QJsonDocument & d, BlockList & out, QString *err)
+    {
+        if (!d.isObject()) return fail(err, "Unknown Json type");
+        const QJsonArray arr = d.object().value(QLatin1String("blocks")).toArray();
+        if (arr.isEmpty()) return fail(err, "Blocks array not found");
+        out.reserve(out.size() + arr.size());
+        for (const QJsonValue & v : arr) {
+            const QJsonObject o = v.toObject();
+            if (o.isEmpty()) return fail(err, "variantMap is empty");
+            if (!o.value(QLatin1String("main_chain")).toBool()) continue;
+            const QJsonValue h = o.value(QLatin1String("height")), t = o.value(QLatin1String("time"));
+            if (!h.isDouble() || !t.isDouble() || h.toDouble() < 0.) return fail(err, "Parse error");
+            out.append(Block(unsigned(h.toDouble()), o.value(QLatin1String("hash")).toString(), qint64(t.toDouble())));
+        }
+        return true;
+    }
+
+    bool parsePage(const QByteArray & page, Arena & arena, BlockList & out, QString *err)
+    {
+        Scanner s(page, arena);
+        if (!s.document() || s.loneSurrogate) {
+            // Pages the scanner won't vouch for are rare, and QJsonDocument decides them, so that
+            // what is accepted, and what comes out, is always exactly parseJson's.
+            QJsonParseError pe;
+            const QJsonDocument d = QJsonDocument::fromJson(page, &pe);
+            if (pe.error != QJsonParseError::NoError) {
+                if (err) *err = QString("error parsing JSON: %1 at offset %2").arg(pe.errorString()).arg(pe.offset);
+                return false;
+            }
+            return parseJson(d, out, err);
+        }
+        if (!s.isObject) return fail(err, "Unknown Json type");
+        const ArenaList<BlockRec> & recs = s.records();
+        if (!s.sawBlocks || !recs.size()) return fail(err, "Blocks array not found");
+        out.reserve(out.size() + recs.size());
+        for (const BlockRec & r : recs) {
+            if (!r.object || r.empty) return fail(err, "variantMap is empty");
+            if (!r.main) continue;
+            if (!r.hasHeight || !r.hasTime || r.height < 0.) return fail(err, "Parse error");
+            out.append(Block(unsigned(r.height), QString::fromUtf8(r.hash.p, r.hash.n), qint64(r.time)));
+        }
+        return true;
+    }
+}
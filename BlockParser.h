@@ -0,0 +1,28 @@
+#ifndef BLOCKPARSER_H
+#define BLOCKPARSER_H
+
+#include "Block.h"
+
+class QByteArray;
+class QJsonDocument;
+class Arena;
+
+/// Extracts the main-chain blocks from a parsed blockchain.info /blocks page, appending them to out.
+/// On malformed input they return false and set *err.
+namespace BlockParser
+{
+    /// Original path: converts the whole document to a QVariantMap first.
+    bool parseVariant(const QJsonDocument & d, BlockList & out, QString *err);
+    /// Walks the QJsonObject/QJsonArray directly, without the intermediate QVariant tree.
+    bool parseJson(const QJsonDocument & d, BlockList & out, QString *err);
+    /// Scans the page's bytes directly, with no QJsonDocument at all: keys and values are looked
+    /// at in place, and the per-block records (and any strings that need unescaping) go in
+    /// arena, so the only heap allocations left are out's and the block hashes. The caller
+    /// resets the arena once the page is done with. Same results and errors as parseJson, plus
+    /// "error parsing JSON: <QJsonParseError> at offset N" where QJsonDocument::fromJson fails;
+    /// pages the scanner can't be sure of that way are handed to QJsonDocument and parseJson.
+    /// bench --check-parsers compares the two.
+    bool parsePage(const QByteArray & page, Arena & arena, BlockList & out, QString *err);
+}
+
+#endif // BLOCKPARSER_H
@@ -0,0 +1,57 @@
+#include "BlockStore.h"
+#include "Log.h"
+
+void BlockStore::ingest(const Block & b)
+{
+    auto hit = blocks.find(b.height);
+    if (hit != blocks.end()) {
+        if (logDupes)
+            Log("Dupe block found %d (dup2: time=%lld hash=%s / dup1: time=%lld hash=%s)", b.height
+                , b.time, b.hash.toUtf8().constData()
+                , hit->time, hit->hash.toUtf8().constData());
+        // the old block's timestamp stays in the time index, which can't find it at its height any more
+        unsigned h;
+        if (hit->time != b.time && timeIndex.find(hit->time, &h) && h == b.height && !replacedBlocks.contains(hit->time))
+            replacedBlocks.insert(hit->time, *hit);
+    }
+    unsigned th;
+    if (!timeIndex.insert(b.time, b.height, &th)) {
+        if (logDupes) {
+            const Block tb = blockAtTime(b.time, th);
+            Log("Dupe timestamp found %d (dup2: height=%d hash=%s / dup1: height=%d hash=%s)", b.time
+                , b.height, b.hash.toUtf8().constData()
+                , tb.height, tb.hash.toUtf8().constData());
+        }
+        ++nDupeTimes;
+        replacedBlocks.remove(b.time);
+    }
+    if (hit != blocks.end()) *hit = b;
+    else blocks.insert(b.height, b);
+}
+
+Block BlockStore::blockAtTime(qint64 t, unsigned height) const
+{
+    auto r = replacedBlocks.constFind(t);
+    return r != replacedBlocks.constEnd() ? *r : blocks.value(height);
+}
+
+void BlockStore::clear()
+{
+    blocks.clear();
+    timeIndex.clear();
+    replacedBlocks.clear();
+    nDupeTimes = 0;
+}
+
+void BlockStore::restore(const BlockList & heightIndexed, const BlockList & timeIndexed, int dupeTimes)
+{
+    clear();
+    for (const Block & b : heightIndexed) blocks.insert(b.height, b);
+    for (const Block & b : timeIndexed) {
+        timeIndex.insert(b.time, b.height);
+        auto it = blocks.constFind(b.height);
+        if (it == blocks.constEnd() || it->time != b.time || it->hash != b.hash)
+            replacedBlocks.insert(b.time, b);
+    }
+    nDupeTimes = dupeTimes;
+}
@@ -0,0 +1,46 @@
+#ifndef BLOCKSTORE_H
+#define BLOCKSTORE_H
+
+#include "Block.h"
+#include "TimeIndex.h"
+
+/// The downloaded blocks, indexed by height and by timestamp.
+///
+/// Only the height index holds Blocks. The time index holds each distinct timestamp with the
+/// height of the block stored for it, compressed (see TimeIndex), and refers to byHeight() for
+/// the rest, except for the rare block that a later one replaced at its height (replaced()).
+class BlockStore
+{
+public:
+    BlockStore() : nDupeTimes(0), logDupes(true) {}
+
+    /// Adds (or replaces) a block. Blocks seen before and timestamps shared with another block are
+    /// logged (unless setLogDupes(false)); the latter are counted in dupeTimes().
+    void ingest(const Block & b);
+    void ingest(const BlockList & bl) { for (const Block & b : bl) ingest(b); }
+    void clear();
+    /// Replaces the contents with indexes saved earlier (see Checkpoint), without logging.
+    void restore(const BlockList & heightIndexed, const BlockList & timeIndexed, int dupeTimes);
+    void setLogDupes(bool b) { logDupes = b; }
+
+    const BlockMap & byHeight() const { return blocks; }
+    /// Each distinct timestamp with the height of the last block ingested with it.
+    const TimeIndex & byTime() const { return timeIndex; }
+    /// Blocks byTime() still refers to whose height has since been taken by a block with
+    /// another timestamp, by time. Normally empty.
+    const BlockTimeMap & replaced() const { return replacedBlocks; }
+    int dupeTimes() const { return nDupeTimes; }
+    int blockCount() const { return timeIndex.size() + nDupeTimes; } // including duplicate timestamps
+    bool isEmpty() const { return blocks.isEmpty(); }
+
+private:
+    Block blockAtTime(qint64 t, unsigned height) const; // byTime()'s block for t, at height
+
+    BlockMap blocks;
+    TimeIndex timeIndex;
+    BlockTimeMap replacedBlocks;
+    int nDupeTimes;
+    bool logDupes;
+};
+
+#endif // BLOCKSTORE_H
@@ -0,0 +1,59 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QByteArray>
+#include <algorithm>
+#include <climits>
+#include <vector>
+#include "Perf.h"
+
+/// Recycles response body buffers. A page read into a buffer from take() is handed to its
+/// consumer by reference (QByteArray shares rather than copies); if nothing has kept a
+/// reference once the consumer returns, give() keeps the allocation for the next response
+/// instead of freeing it. A buffer taken with the response's Content-Length never grows while
+/// the body is read, so a page typically costs no allocation at all.
+///
+/// Not thread-safe: used from the thread doing the fetching.
+class BufferPool
+{
+public:
+    enum { MaxBuffers = 16, MaxBufferBytes = 16 << 20, DefaultBytes = 64 << 10 };
+
+    /// An empty buffer with room for at least sizeHint bytes (0 = unknown: the roomiest one free).
+    QByteArray take(int sizeHint)
+    {
+        // the smallest buffer that fits, or failing that the largest
+        const int want = sizeHint > 0 ? sizeHint : INT_MAX;
+        int best = -1;
+        for (int i = 0; i < int(free.size()); ++i) {
+            const int cap = free[size_t(i)].capacity(), bestCap = best < 0 ? 0 : free[size_t(best)].capacity();
+            const bool fits = cap >= want, bestFits = best >= 0 && bestCap >= want;
+            if (best < 0 || (fits && (!bestFits || cap < bestCap)) || (!fits && !bestFits && cap > bestCap))
+                best = i;
+        }
+        QByteArray b;
+        if (best >= 0) {
+            b = std::move(free[size_t(best)]);
+            free.erase(free.begin() + best);
+            Perf::count(Perf::BuffersReused);
+        }
+        if (b.capacity() < sizeHint || !b.capacity())
+            b.reserve(std::max(int(sizeHint), int(DefaultBytes))); // reserved, so resize(0) later keeps it
+        return b;
+    }
+
+    /// Takes b back if nothing else refers to it; b is left empty either way.
+    void give(QByteArray & b)
+    {
+        if (b.capacity() && b.isDetached() && b.capacity() <= MaxBufferBytes && free.size() < MaxBuffers) {
+            b.resize(0);
+            free.push_back(std::move(b));
+        }
+        b = QByteArray();
+    }
+
+private:
+    std::vector<QByteArray> free;
+};
+
+#endif // BUFFERPOOL_H
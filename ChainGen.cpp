@@ -0,0 +1,239 @@
+#include "ChainGen.h"
+#include <QFile>
+#include <QDir>
+#include <QByteArray>
+#include <QMap>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace {
+    const qint64 DaySecs = 24ll*60ll*60ll;
+    const quint64 RetargetInterval = 2016;
+
+    quint64 splitmix64(quint64 x)
+    {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    qint64 floorDay(qint64 t) { return t >= 0 ? t / DaySecs : (t - DaySecs + 1) / DaySecs; }
+
+    void appendHex(QByteArray & out, const quint8 *p, int n)
+    {
+        static const char digits[] = "0123456789abcdef";
+        const int at = out.size();
+        out.resize(at + 2*n);
+        char *o = out.data() + at;
+        for (int i = 0; i < n; ++i) {
+            *o++ = digits[p[i] >> 4];
+            *o++ = digits[p[i] & 0xf];
+        }
+    }
+
+    bool writePage(const QDir & dir, qint64 day, const QByteArray & entries)
+    {
+        QFile f(dir.filePath(QString("%1.json").arg(day)));
+        if (!f.open(QIODevice::WriteOnly|QIODevice::Truncate)) return false;
+        const QByteArray page = "{\"blocks\":[" + entries + "]}";
+        return f.write(page) == page.size();
+    }
+}
+
+ChainGen::ChainGen(const Config & c) : cfg(c)
+{
+    if (cfg.nBlocks > quint64(0xffffffffu)) cfg.nBlocks = 0xffffffffu; // heights are 32-bit
+    if (cfg.spacing <= 0.) cfg.spacing = 600.;
+    if (cfg.maxSkew < 0) cfg.maxSkew = 0;
+    if (cfg.threads <= 0) cfg.threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    plan();
+}
+
+quint64 ChainGen::rand(quint64 height, unsigned salt) const
+{
+    return splitmix64(cfg.seed ^ splitmix64(height*8 + salt));
+}
+
+double ChainGen::unit(quint64 height, unsigned salt) const
+{
+    return double(rand(height, salt) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+qint64 ChainGen::interval(quint64 height) const
+{
+    if (!height) return 0;
+    const double progress = double(height % RetargetInterval) / double(RetargetInterval);
+    const double mean = cfg.spacing / (1. + cfg.drift * progress);
+    return qint64(std::llround(-mean * std::log1p(-unit(height, 0))));
+}
+
+void ChainGen::appendJson(QByteArray & out, const BlockFile::Record & r)
+{
+    if (!out.isEmpty()) out += ',';
+    out += "{\"hash\":\"";
+    appendHex(out, r.hash, 32);
+    out += "\",\"height\":";
+    out += QByteArray::number(r.height);
+    out += ",\"time\":";
+    out += QByteArray::number(r.time);
+    out += (r.flags & BlockFile::MainChain) ? ",\"main_chain\":true}" : ",\"main_chain\":false}";
+}
+
+template <typename F>
+void ChainGen::parallel(F && f) const
+{
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    const int n = std::min(cfg.threads, int(std::max(size_t(1), chunks.size())));
+    for (int i = 0; i < n; ++i)
+        workers.emplace_back([&]{
+            for (size_t c; (c = next.fetch_add(1)) < chunks.size(); )
+                f(c);
+        });
+    for (auto & w : workers) w.join();
+}
+
+template <typename F>
+void ChainGen::generate(const Chunk & c, F && sink) const
+{
+    BlockFile::Record r;
+    qint64 t = c.baseTime;
+    for (quint64 h = c.firstHeight; h < c.endHeight; ++h) {
+        t += interval(h);
+        r.height = quint32(h);
+        r.flags = BlockFile::MainChain;
+        r.time = t;
+        if (cfg.outOfOrderRate > 0. && unit(h, 1) < cfg.outOfOrderRate)
+            r.time += qint64(rand(h, 2) % quint64(2*cfg.maxSkew + 1)) - cfg.maxSkew;
+        // leading zero bytes like a real block hash, the rest derived from (seed, height)
+        quint64 x = rand(h, 3);
+        std::fill(r.hash, r.hash + 8, quint8(0));
+        for (int i = 1; i < 4; ++i)
+            qToBigEndian<quint64>(x = splitmix64(x), r.hash + 8*i);
+        sink(r);
+        if (cfg.duplicateRate > 0. && unit(h, 4) < cfg.duplicateRate)
+            sink(r);
+        if (cfg.orphanRate > 0. && unit(h, 5) < cfg.orphanRate) {
+            r.flags = 0;
+            r.time += qint64(rand(h, 6) % OrphanMaxOffset);
+            r.hash[31] ^= 0xff;
+            sink(r);
+        }
+    }
+}
+
+void ChainGen::plan()
+{
+    chunks.clear();
+    for (quint64 h = 0; h < cfg.nBlocks; h += ChunkHeights) {
+        Chunk c;
+        c.firstHeight = h;
+        c.endHeight = std::min(cfg.nBlocks, h + ChunkHeights);
+        c.baseTime = c.endTime = 0;
+        c.firstRecord = c.nRecords = 0;
+        chunks.push_back(c);
+    }
+    // pass 1: each chunk's total time span and record count, independently
+    std::vector<Chunk> & cs = chunks;
+    parallel([&](size_t i) {
+        Chunk & c = cs[i];
+        qint64 span = 0;
+        quint64 n = 0;
+        for (quint64 h = c.firstHeight; h < c.endHeight; ++h) {
+            span += interval(h);
+            ++n;
+            if (cfg.duplicateRate > 0. && unit(h, 4) < cfg.duplicateRate) ++n;
+            if (cfg.orphanRate > 0. && unit(h, 5) < cfg.orphanRate) ++n;
+        }
+        c.endTime = span;
+        c.nRecords = n;
+    });
+    // prefix sums turn the per-chunk totals into absolute start times and record offsets
+    qint64 t = cfg.genesisTime;
+    quint64 rec = 0;
+    for (Chunk & c : chunks) {
+        c.baseTime = t;
+        c.endTime += t;
+        t = c.endTime;
+        c.firstRecord = rec;
+        rec += c.nRecords;
+    }
+    nRecords = rec;
+}
+
+bool ChainGen::writeBinary(const QString & fileName, QString *err) const
+{
+    QFile f(fileName);
+    const qint64 size = qint64(BlockFile::HeaderSize) + qint64(nRecords) * BlockFile::RecordSize;
+    if (!f.open(QIODevice::ReadWrite|QIODevice::Truncate) || !f.resize(size)) {
+        if (err) *err = f.errorString();
+        return false;
+    }
+    uchar *m = f.map(0, size);
+    if (!m) {
+        if (err) *err = f.errorString();
+        return false;
+    }
+    BlockFile::encodeHeader(nRecords, reinterpret_cast<char *>(m));
+    // pass 2: chunks own disjoint record ranges, so workers encode straight into the mapping
+    parallel([&](size_t i) {
+        const Chunk & c = chunks[i];
+        char *out = reinterpret_cast<char *>(m) + BlockFile::HeaderSize + c.firstRecord * BlockFile::RecordSize;
+        generate(c, [&](const BlockFile::Record & r) {
+            BlockFile::encode(r, out);
+            out += BlockFile::RecordSize;
+        });
+    });
+    f.unmap(m);
+    f.close();
+    return true;
+}
+
+bool ChainGen::writeJsonPages(const QString & dirName, QString *err) const
+{
+    QDir dir(dirName);
+    if (!dir.mkpath(".")) {
+        if (err) *err = QString("could not create %1").arg(dirName);
+        return false;
+    }
+    // A day can only receive records from neighbouring chunks if it lies within the skew (and
+    // orphan offset) margin of a chunk boundary. Each worker writes the days it owns outright
+    // and hands back the boundary days, which are merged in chunk order afterwards.
+    const qint64 margin = (cfg.outOfOrderRate > 0. ? cfg.maxSkew : 0) + OrphanMaxOffset;
+    std::vector<QMap<qint64, QByteArray>> shared(chunks.size());
+    std::atomic<bool> ok(true);
+    parallel([&](size_t i) {
+        const Chunk & c = chunks[i];
+        QMap<qint64, QByteArray> days;
+        generate(c, [&](const BlockFile::Record & r) { appendJson(days[floorDay(r.time)], r); });
+        for (auto it = days.begin(); it != days.end(); ++it) {
+            const qint64 from = it.key()*DaySecs, to = from + DaySecs;
+            if (from > c.baseTime + margin && to <= c.endTime - margin) {
+                if (!writePage(dir, it.key(), it.value())) ok = false;
+            } else {
+                shared[i].insert(it.key(), it.value());
+            }
+        }
+    });
+    QMap<qint64, QByteArray> merged;
+    for (const auto & m : shared)
+        for (auto it = m.begin(); it != m.end(); ++it) {
+            QByteArray & page = merged[it.key()];
+            if (!page.isEmpty()) page += ',';
+            page += it.value();
+        }
+    for (auto it = merged.begin(); it != merged.end(); ++it)
+        if (!writePage(dir, it.key(), it.value())) ok = false;
+    if (!ok && err) *err = QString("could not write pages to %1").arg(dirName);
+    return ok;
+}
+
+void ChainGen::forEachRecord(const std::function<void(const BlockFile::Record &)> & f) const
+{
+    for (const Chunk & c : chunks)
+        generate(c, f);
+}
@@ -0,0 +1,72 @@
+#ifndef CHAINGEN_H
+#define CHAINGEN_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QByteArray>
+#include <vector>
+#include <functional>
+#include "BlockFile.h"
+
+/// Deterministic synthetic blockchain for scaling tests.
+///
+/// Block intervals are exponential (Poisson arrivals) with a mean that shrinks as hashrate
+/// drifts upward between 2016-block retargets. Optionally some timestamps are skewed out of
+/// order, some blocks are listed twice and some heights get a main_chain:false orphan sibling.
+/// Every random choice is a pure function of (seed, height), so the output is identical for
+/// any thread count, and generation runs in two parallel passes over chunks of heights.
+class ChainGen
+{
+public:
+    struct Config
+    {
+        quint64 nBlocks = 1000000;
+        quint64 seed = 1;
+        qint64 genesisTime = 1231006505;
+        double spacing = 600.;       // mean block interval right after a retarget, seconds
+        double drift = 0.;           // hashrate growth over one 2016-block retarget period (0.05 = 5%)
+        double outOfOrderRate = 0.;  // fraction of blocks whose timestamp is skewed by up to +/- maxSkew
+        qint64 maxSkew = 7200;
+        double duplicateRate = 0.;   // fraction of blocks listed twice
+        double orphanRate = 0.;      // fraction of heights that also get a main_chain:false sibling
+        int threads = 0;             // 0 = one per core
+    };
+
+    explicit ChainGen(const Config & c);
+
+    const Config & config() const { return cfg; }
+    quint64 recordCount() const { return nRecords; }
+
+    /// Writes all records to a BlockFile store. Returns false and sets *err on failure.
+    bool writeBinary(const QString & fileName, QString *err = nullptr) const;
+    /// Writes blockchain.info-shaped {"blocks":[...]} pages, one <utc day>.json per day,
+    /// as served by mockserver --record-dir.
+    bool writeJsonPages(const QString & dir, QString *err = nullptr) const;
+    /// Calls f for every record in height order, on the calling thread.
+    void forEachRecord(const std::function<void(const BlockFile::Record &)> & f) const;
+
+    /// Appends r to out as a blockchain.info block object, comma-separated from any previous one.
+    static void appendJson(QByteArray & out, const BlockFile::Record & r);
+
+private:
+    enum { ChunkHeights = 1 << 18, OrphanMaxOffset = 120 };
+    struct Chunk
+    {
+        quint64 firstHeight, endHeight;
+        qint64 baseTime, endTime;  // unskewed time before the first block / of the last block
+        quint64 firstRecord, nRecords;
+    };
+
+    quint64 rand(quint64 height, unsigned salt) const;
+    double unit(quint64 height, unsigned salt) const;
+    qint64 interval(quint64 height) const;
+    void plan();
+    template <typename F> void generate(const Chunk & c, F && sink) const;
+    template <typename F> void parallel(F && f) const;
+
+    Config cfg;
+    std::vector<Chunk> chunks;
+    quint64 nRecords = 0;
+};
+
+#endif // CHAINGEN_H
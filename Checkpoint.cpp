@@ -0,0 +1,109 @@
+#include "Checkpoint.h"
+#include "BlockFile.h"
+#include <QSaveFile>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QList>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace Checkpoint
+{
+    namespace {
+        bool fail(QString *err, const QString & msg)
+        {
+            if (err) *err = msg;
+            return false;
+        }
+    }
+
+    bool save(const QString & fileName, const BlockStore & store, const Cursor & cursor, QString *err)
+    {
+        // byHeight() holds every block; byTime() mostly the same ones, except where a later block
+        // with the same timestamp replaced an earlier one, and for the blocks in replaced(), which
+        // get their own record.
+        QByteArray buf;
+        buf.reserve(BlockFile::HeaderSize + (store.byHeight().size() + 16) * BlockFile::RecordSize);
+        buf.resize(BlockFile::HeaderSize);
+        quint64 n = 0;
+        auto append = [&](const Block & b, quint32 flags) {
+            BlockFile::Record r;
+            r.height = b.height;
+            r.flags = flags;
+            r.time = b.time;
+            if (!BlockFile::setHash(r, b.hash.toLatin1())) return false;
+            buf.resize(buf.size() + BlockFile::RecordSize);
+            BlockFile::encode(r, buf.data() + buf.size() - BlockFile::RecordSize);
+            ++n;
+            return true;
+        };
+        // one pass over the time index marks the heights whose block byTime() refers to
+        std::vector<bool> timeIndexed(store.isEmpty() ? 0 : size_t(store.byHeight().lastKey()) + 1);
+        store.byTime().scan(std::numeric_limits<qint64>::min(), std::numeric_limits<qint64>::max(), [&](qint64 t, unsigned h) {
+            if (h < timeIndexed.size() && !store.replaced().contains(t)) timeIndexed[h] = true;
+        });
+        for (const Block & b : store.byHeight()) {
+            if (!append(b, BlockFile::MainChain | BlockFile::HeightIndexed | (timeIndexed[b.height] ? BlockFile::TimeIndexed : 0)))
+                return fail(err, QString("block %1 has an unexpected hash %2").arg(b.height).arg(b.hash));
+        }
+        for (const Block & b : store.replaced()) {
+            if (!append(b, BlockFile::MainChain | BlockFile::TimeIndexed))
+                return fail(err, QString("block %1 has an unexpected hash %2").arg(b.height).arg(b.hash));
+        }
+        BlockFile::encodeHeader(n, buf.data());
+
+        QList<int> days = cursor.daysDone.values();
+        std::sort(days.begin(), days.end());
+        QJsonArray daysArr;
+        for (int d : days) daysArr.append(d);
+        QJsonObject trailer;
+        trailer["start_ms"] = double(cursor.startMs);
+        trailer["base_url"] = cursor.baseUrl;
+        trailer["days_done"] = daysArr;
+        trailer["dupe_times"] = store.dupeTimes();
+        buf += QJsonDocument(trailer).toJson(QJsonDocument::Compact);
+
+        QSaveFile f(fileName);
+        if (!f.open(QIODevice::WriteOnly) || f.write(buf) != buf.size() || !f.commit())
+            return fail(err, f.errorString());
+        return true;
+    }
+
+    bool load(const QString & fileName, BlockStore & store, Cursor & cursor, QString *err)
+    {
+        QFile f(fileName);
+        if (!f.open(QIODevice::ReadOnly))
+            return fail(err, f.errorString());
+        const QByteArray buf = f.readAll();
+        quint64 n = 0;
+        if (buf.size() < BlockFile::HeaderSize || !BlockFile::decodeHeader(buf.constData(), &n)
+                || quint64(buf.size() - BlockFile::HeaderSize) / BlockFile::RecordSize < n)
+            return fail(err, "not a checkpoint file, or truncated");
+        const int trailerAt = BlockFile::HeaderSize + int(n) * BlockFile::RecordSize;
+        QJsonParseError pe;
+        const QJsonObject trailer = QJsonDocument::fromJson(buf.mid(trailerAt), &pe).object();
+        if (pe.error != QJsonParseError::NoError || !trailer.contains("start_ms"))
+            return fail(err, "checkpoint trailer is missing or corrupt");
+
+        BlockList heightIndexed, timeIndexed;
+        heightIndexed.reserve(int(n));
+        BlockFile::Record r;
+        for (quint64 i = 0; i < n; ++i) {
+            BlockFile::decode(buf.constData() + BlockFile::HeaderSize + i * BlockFile::RecordSize, r);
+            const Block b(r.height, QString::fromLatin1(BlockFile::hashHex(r)), r.time);
+            if (r.flags & BlockFile::HeightIndexed) heightIndexed.append(b);
+            if (r.flags & BlockFile::TimeIndexed) timeIndexed.append(b);
+        }
+        store.restore(heightIndexed, timeIndexed, trailer.value("dupe_times").toInt());
+
+        cursor.startMs = qint64(trailer.value("start_ms").toDouble());
+        cursor.baseUrl = trailer.value("base_url").toString();
+        cursor.daysDone.clear();
+        for (const QJsonValue & v : trailer.value("days_done").toArray())
+            cursor.daysDone.insert(v.toInt());
+        return true;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <QString>
+#include <QSet>
+#include "BlockStore.h"
+
+/// Crash-consistent snapshots of a download in progress, for --resume.
+///
+/// A checkpoint is a BlockFile (header plus one record per block, flagged with the index(es) it
+/// belongs to) followed by a small JSON trailer holding the fetch cursor and the duplicate
+/// count. It is written to a temporary file and renamed over the old one, so a crash at any
+/// point leaves either the previous checkpoint or the new one, never a torn file.
+namespace Checkpoint
+{
+    struct Cursor
+    {
+        qint64 startMs = 0;   // the run's "now"; day k is the UTC day containing startMs - k days
+        QSet<int> daysDone;   // days whose page has been ingested
+        QString baseUrl;
+    };
+
+    bool save(const QString & fileName, const BlockStore & store, const Cursor & cursor, QString *err = nullptr);
+    bool load(const QString & fileName, BlockStore & store, Cursor & cursor, QString *err = nullptr);
+}
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,212 @@
+#ifndef CORO_H
+#define CORO_H
+
+#ifdef BCG_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <QByteArray>
+#include <QString>
+#include <QUrl>
+#include "Fetcher.h"
+
+/// C++20 coroutines over the Qt event loop (qmake CONFIG+=coroutines).
+///
+///     Coro::Task<void> MainObj::fetchDay(int day) {
+///         const Coro::FetchResult r = co_await Coro::fetch(fetcher, url, day);
+///         ...
+///     }
+///     co_await Coro::whenAll(std::move(tasks)); // fan out, resume once all are done
+///
+/// A Task is lazy: it starts when awaited (or spawn()ed) and resumes its awaiter by symmetric
+/// transfer when it finishes. fetch() is a plain awaiter that resumes the coroutine straight
+/// from the Fetcher callback on the event loop thread, so there are no thread hops, and the
+/// only allocation per request is the frame of the coroutine doing the request.
+namespace Coro
+{
+    template <typename T> class Task;
+
+    namespace detail {
+        struct PromiseBase
+        {
+            std::coroutine_handle<> continuation;                  // awaiting coroutine, if any
+            std::coroutine_handle<> (*onDone)(void *) = nullptr;   // ... or this (whenAll), if any
+            void *onDoneCtx = nullptr;
+            bool detached = false;                                 // spawn()ed: frees itself at the end
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            void unhandled_exception() noexcept { std::terminate(); } // errors are reported with Fatal, not thrown
+
+            struct FinalAwaiter
+            {
+                bool await_ready() const noexcept { return false; }
+                template <typename P>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept
+                {
+                    PromiseBase & p = h.promise();
+                    if (p.continuation) return p.continuation;
+                    if (p.onDone) return p.onDone(p.onDoneCtx);
+                    if (p.detached) h.destroy();
+                    return std::noop_coroutine();
+                }
+                void await_resume() const noexcept {}
+            };
+            FinalAwaiter final_suspend() noexcept { return {}; }
+        };
+
+        template <typename T>
+        struct Promise : PromiseBase
+        {
+            std::optional<T> value;
+            Task<T> get_return_object();
+            void return_value(T v) { value = std::move(v); }
+            T take() { return std::move(*value); }
+        };
+
+        template <>
+        struct Promise<void> : PromiseBase
+        {
+            Task<void> get_return_object();
+            void return_void() {}
+            void take() {}
+        };
+    }
+
+    template <typename T>
+    class Task
+    {
+    public:
+        typedef detail::Promise<T> promise_type;
+        typedef std::coroutine_handle<promise_type> Handle;
+
+        Task() = default;
+        explicit Task(Handle h) : h(h) {}
+        Task(Task && o) noexcept : h(std::exchange(o.h, {})) {}
+        Task & operator=(Task && o) noexcept { if (this != &o) { reset(); h = std::exchange(o.h, {}); } return *this; }
+        Task(const Task &) = delete;
+        Task & operator=(const Task &) = delete;
+        ~Task() { reset(); }
+
+        bool await_ready() const noexcept { return !h || h.done(); }
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            h.promise().continuation = awaiting;
+            return h; // start (or continue) the task right away
+        }
+        T await_resume() { return h.promise().take(); }
+
+        Handle handle() const { return h; }
+        Handle release() { return std::exchange(h, {}); }
+
+    private:
+        void reset() { if (h) h.destroy(); h = {}; }
+        Handle h;
+    };
+
+    namespace detail {
+        template <typename T>
+        Task<T> Promise<T>::get_return_object() { return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this)); }
+        inline Task<void> Promise<void>::get_return_object() { return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this)); }
+    }
+
+    /// Starts t without anyone awaiting it; its frame is freed when it finishes.
+    inline void spawn(Task<void> t)
+    {
+        std::coroutine_handle<detail::Promise<void>> h = t.release();
+        if (!h) return;
+        h.promise().detached = true;
+        h.resume();
+    }
+
+    /// Awaiter that starts every task at once and resumes the awaiting coroutine when the last
+    /// one finishes. Yields their results in order (nothing for Task<void>).
+    template <typename T>
+    class WhenAll
+    {
+    public:
+        explicit WhenAll(std::vector<Task<T>> && t) : tasks(std::move(t)) {}
+
+        bool await_ready() const noexcept { return tasks.empty(); }
+        bool await_suspend(std::coroutine_handle<> awaiting)
+        {
+            parent = awaiting;
+            remaining = tasks.size() + 1; // +1 until every task has been started
+            for (Task<T> & t : tasks) {
+                auto & p = t.handle().promise();
+                p.onDone = &WhenAll::taskDone;
+                p.onDoneCtx = this;
+                t.handle().resume(); // runs to its first suspension (typically a fetch)
+            }
+            return --remaining > 0; // all finished synchronously: don't suspend at all
+        }
+        auto await_resume()
+        {
+            if constexpr (std::is_void<T>::value) {
+                return;
+            } else {
+                std::vector<T> results;
+                results.reserve(tasks.size());
+                for (Task<T> & t : tasks) results.push_back(t.handle().promise().take());
+                return results;
+            }
+        }
+
+    private:
+        static std::coroutine_handle<> taskDone(void *ctx)
+        {
+            WhenAll *w = static_cast<WhenAll *>(ctx);
+            return --w->remaining == 0 ? w->parent : std::noop_coroutine();
+        }
+
+        std::vector<Task<T>> tasks;
+        std::coroutine_handle<> parent;
+        size_t remaining = 0;
+    };
+
+    template <typename T>
+    WhenAll<T> whenAll(std::vector<Task<T>> && tasks) { return WhenAll<T>(std::move(tasks)); }
+
+    struct FetchResult
+    {
+        bool ok = false;
+        QByteArray body;
+        QString error; // if !ok: the fetcher gave up after its retries
+    };
+
+    /// co_await fetch(fetcher, url, tag): a Fetcher::get() that resumes the coroutine with its result.
+    class FetchAwaiter
+    {
+    public:
+        FetchAwaiter(Fetcher & f, const QUrl & url, qint64 tag) : fetcher(f), url(url), tag(tag) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            fetcher.get(url, tag, [this,h](const QByteArray & body) {
+                result.ok = true;
+                result.body = body;
+                h.resume();
+            }, [this,h](const QString & err) {
+                result.error = err;
+                h.resume();
+            });
+        }
+        FetchResult await_resume() { return std::move(result); }
+
+    private:
+        Fetcher & fetcher;
+        const QUrl url;
+        const qint64 tag;
+        FetchResult result;
+    };
+
+    inline FetchAwaiter fetch(Fetcher & f, const QUrl & url, qint64 tag) { return FetchAwaiter(f, url, tag); }
+}
+
+#endif // BCG_COROUTINES
+
+#endif // CORO_H
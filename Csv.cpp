@@ -0,0 +1,20 @@
+#include "Csv.h"
+#include <QIODevice>
+
+namespace Csv
+{
+    void write(QIODevice & f, const BlockMap & blocks, Columns cols)
+    {
+        if (cols == HeightTimeHash) {
+            f.write(QString().sprintf("#BlockHeight,BlockTimeUTC,BlockHash\n").toUtf8());
+            for(const Block & b: blocks) {
+                f.write(QString().sprintf("%d,%lld,%s\n",b.height,b.time,b.hash.toUtf8().constData()).toUtf8());
+            }
+        } else {
+            f.write(QString().sprintf("#BlockTimeUTC,BlockHeight,BlockHash\n").toUtf8());
+            for(const Block & b: blocks) {
+                f.write(QString().sprintf("%lld,%d,%s\n",b.time,b.height,b.hash.toUtf8().constData()).toUtf8());
+            }
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include "Block.h"
+
+class QIODevice;
+
+namespace Csv
+{
+    enum Columns { HeightTimeHash, TimeHeightHash };
+
+    /// Writes a header line and one line per block, in the container's order.
+    void write(QIODevice & out, const BlockMap & blocks, Columns cols);
+}
+
+#endif // CSV_H
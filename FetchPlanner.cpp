@@ -0,0 +1,78 @@
+#include "FetchPlanner.h"
+#include <QSet>
+#include <QString>
+#include <algorithm>
+#include <limits>
+
+namespace {
+    const qint64 DaySecs = 24ll*60ll*60ll, DayMs = DaySecs*1000ll;
+
+    qint64 floorDiv(qint64 a, qint64 b) { return a >= 0 ? a / b : (a - b + 1) / b; }
+}
+
+qint64 FetchPlanner::dayTimestampMs(int day) const
+{
+    return startMs - qint64(day)*DayMs;
+}
+
+void FetchPlanner::pageFetched(const BlockList & page, qint64 bytes, const BlockMap & before, bool refill)
+{
+    int known = 0;
+    for (const Block & b : page)
+        if (before.contains(b.height)) ++known;
+    if (refill) {
+        ++refillPages;
+        refillBytes += bytes;
+    } else {
+        ++dayPages;
+        dayBytes += bytes;
+        dayBlocks += page.size();
+    }
+    overlapBlocks += known;
+    if (!page.isEmpty()) overlapBytes += bytes * known / page.size();
+}
+
+QList<unsigned> FetchPlanner::heightGaps(const BlockMap & blocks, int maxGaps) const
+{
+    QList<unsigned> ret;
+    if (blocks.isEmpty()) return ret;
+    unsigned prev = blocks.firstKey();
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        for (unsigned h = prev + 1; h < it.key(); ++h) {
+            if (ret.size() >= maxGaps) return ret;
+            ret.append(h);
+        }
+        prev = it.key();
+    }
+    return ret;
+}
+
+QStringList FetchPlanner::summaryLines(const BlockStore & store) const
+{
+    // Replay the old stepping over the blocks we ended up with: each request asked for
+    // (earliest block so far - 1 day) and got that UTC day's blocks. An empty page left the
+    // cursor where it was, so the same day was fetched again.
+    qint64 ts = startMs, earliest = std::numeric_limits<qint64>::max(), naiveBlocks = 0, naiveDupes = 0;
+    QSet<unsigned> seen;
+    for (int i = 0; i < ndays; ++i) {
+        const qint64 from = floorDiv(ts, DayMs) * DaySecs;
+        store.byTime().scan(from, from + DaySecs, [&](qint64 t, unsigned height) {
+            ++naiveBlocks;
+            if (seen.contains(height)) ++naiveDupes;
+            else seen.insert(height);
+            earliest = std::min(earliest, t);
+        });
+        if (earliest != std::numeric_limits<qint64>::max()) ts = earliest*1000ll - DayMs;
+    }
+    const double bytesPerBlock = dayBlocks ? double(dayBytes) / double(dayBlocks) : 0.;
+    const qint64 naiveBytes = qint64(double(naiveBlocks) * bytesPerBlock), ourBytes = dayBytes + refillBytes;
+
+    QStringList ret;
+    ret << QString().sprintf("Fetch plan: %d day pages (%lld bytes), %d refill pages for missing heights (%lld bytes), "
+                             "%lld blocks received twice (~%lld bytes)", dayPages, dayBytes, refillPages, refillBytes,
+                             overlapBlocks, overlapBytes);
+    ret << QString().sprintf("Naive stepping would have fetched %d pages with %lld blocks, %lld of them duplicates "
+                             "(~%lld bytes); saved ~%lld bytes", ndays, naiveBlocks, naiveDupes, naiveBytes, naiveBytes - ourBytes);
+    ret << QString().sprintf("Height gaps left: %d", heightGaps(store.byHeight(), std::numeric_limits<int>::max()).size());
+    return ret;
+}
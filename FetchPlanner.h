@@ -0,0 +1,37 @@
+#ifndef FETCHPLANNER_H
+#define FETCHPLANNER_H
+
+#include <QtGlobal>
+#include <QList>
+#include <QStringList>
+#include "BlockStore.h"
+
+/// Decides which pages a run fetches, and accounts for what they brought in.
+///
+/// Day k's page is requested for startMs - k days. Pages cover whole UTC days, so the k pages
+/// tile time without overlap. After ingestion, heightGaps() finds the heights missing between
+/// the lowest and highest block seen, which are then fetched one by one (/block-height/<h>)
+/// instead of being left as silent holes. The planner also replays the old "earliest block
+/// minus one day" stepping over the final data, so the summary can show what that would have cost.
+class FetchPlanner
+{
+public:
+    FetchPlanner(qint64 startMs = 0, int ndays = 0) : startMs(startMs), ndays(ndays) {}
+
+    qint64 dayTimestampMs(int day) const;
+    /// Records a day (or refill) page: its size and how many of its blocks were already known.
+    void pageFetched(const BlockList & page, qint64 bytes, const BlockMap & before, bool refill);
+    /// Heights missing from blocks between its lowest and highest, at most maxGaps of them.
+    QList<unsigned> heightGaps(const BlockMap & blocks, int maxGaps) const;
+
+    QStringList summaryLines(const BlockStore & store) const;
+
+private:
+    qint64 startMs;
+    int ndays;
+    int dayPages = 0, refillPages = 0;
+    qint64 dayBytes = 0, refillBytes = 0, dayBlocks = 0;
+    qint64 overlapBlocks = 0, overlapBytes = 0;
+};
+
+#endif // FETCHPLANNER_H
@@ -0,0 +1,489 @@
+#include "Fetcher.h"
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QHostInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QList>
+#include <algorithm>
+#include <cmath>
+#include "Log.h"
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+    const int DefaultTicketLifetimeSecs = 2*60*60; // when the server doesn't say
+
+    // dirName exists, is ours and nobody else can get at anything in it
+    bool privateDir(const QString & dirName, QString *err)
+    {
+        const QFileDevice::Permissions owner = QFileDevice::ReadOwner|QFileDevice::WriteOwner|QFileDevice::ExeOwner;
+        if (!QFileInfo::exists(dirName)) {
+            // created empty, so tightening it straight after leaves nothing exposed
+            if (!QDir().mkpath(dirName) || !QFile::setPermissions(dirName, owner)) {
+                *err = "could not create " + dirName;
+                return false;
+            }
+        }
+        const QFileInfo fi(dirName);
+        const QFileDevice::Permissions others = QFileDevice::ReadGroup|QFileDevice::WriteGroup|QFileDevice::ExeGroup
+                                              | QFileDevice::ReadOther|QFileDevice::WriteOther|QFileDevice::ExeOther;
+        if (!fi.isDir() || (fi.permissions() & others)) {
+            *err = dirName + " is accessible to other users";
+            return false;
+        }
+#ifdef Q_OS_UNIX
+        if (fi.ownerId() != uint(::getuid())) {
+            *err = dirName + " belongs to another user";
+            return false;
+        }
+#endif
+        return true;
+    }
+}
+
+Fetcher::Fetcher(const Config & c, QObject *parent) : QObject(parent), cfg(c)
+{
+    if (cfg.maxConcurrency < 1) cfg.maxConcurrency = 1;
+    cfg.initialConcurrency = std::max(1, std::min(cfg.initialConcurrency, cfg.maxConcurrency));
+    if (cfg.burst <= 0) cfg.burst = std::max(1, int(std::ceil(cfg.rate)));
+    cfg.http.compress = cfg.compress;
+    tls = QSslConfiguration::defaultConfiguration();
+    tls.setSslOption(QSsl::SslOptionDisableSessionPersistence, false); // Qt forgets sessions by default
+    limit = cfg.initialConcurrency;
+    tokens = cfg.burst;
+    tokensAt = Perf::nowNs();
+    Perf::sample(Perf::Concurrency, concurrency());
+}
+
+void Fetcher::get(const QUrl & url, qint64 tag, const DoneFn & done, const FailFn & fail)
+{
+    enqueue(url, QByteArray(), tag, [done](int, const QByteArray & body, const QByteArray &){ done(body); }, fail);
+}
+
+void Fetcher::getConditional(const QUrl & url, const QByteArray & etag, qint64 tag, const ConditionalFn & done, const FailFn & fail)
+{
+    enqueue(url, etag, tag, done, fail);
+}
+
+void Fetcher::enqueue(const QUrl & url, const QByteArray & etag, qint64 tag, const ConditionalFn & done, const FailFn & fail)
+{
+    std::shared_ptr<Request> req = std::make_shared<Request>();
+    req->url = url;
+    req->etag = etag;
+    req->tag = tag;
+    req->start = Perf::nowNs();
+    req->done = done;
+    req->fail = fail;
+    pending.append(req);
+    pump();
+}
+
+bool Fetcher::takeToken()
+{
+    if (cfg.rate <= 0.) return true;
+    const qint64 now = Perf::nowNs();
+    tokens = std::min(double(cfg.burst), tokens + double(now - tokensAt) / 1e9 * cfg.rate);
+    tokensAt = now;
+    if (tokens < 1.) return false;
+    tokens -= 1.;
+    return true;
+}
+
+void Fetcher::setHold(bool h)
+{
+    if (h == held) return;
+    held = h;
+    if (!held) pump();
+}
+
+void Fetcher::pump()
+{
+    while (!held && !pending.isEmpty() && inFlight < concurrency()) {
+        if (!takeToken()) {
+            if (!pumpScheduled) {
+                pumpScheduled = true;
+                const int waitMs = std::max(1, int(std::ceil((1. - tokens) / cfg.rate * 1000.)));
+                QTimer::singleShot(waitMs, this, [this]{
+                    pumpScheduled = false;
+                    pump();
+                });
+            }
+            return;
+        }
+        startAttempt(pending.takeFirst(), false);
+    }
+}
+
+void Fetcher::startAttempt(const std::shared_ptr<Request> & req, bool hedge)
+{
+    const quint64 id = nextAttempt++;
+    Attempt & a = attempts[id];
+    a.req = req;
+    a.start = Perf::nowNs();
+    a.hedge = hedge;
+    ++req->live;
+    Perf::setGauge(Perf::RequestsInFlight, ++inFlight);
+    TRACE_ASYNC_BEGIN(hedge ? "hedge" : "reply", id, req->tag);
+    if (cfg.lean) sendLean(id, a);
+    else sendQt(id, a);
+    if (cfg.timeoutMs > 0)
+        QTimer::singleShot(cfg.timeoutMs, this, [this,id]{
+            auto it = attempts.find(id);
+            if (it == attempts.end()) return; // already finished
+            it->timedOut = true;
+            abortAttempt(*it);
+        });
+    // Hedge the first attempt of each round if it outlives the p95; retries after a failure
+    // are already spaced by the backoff, so one duplicate per round is plenty. A hedge still
+    // has to fit under the concurrency limit, so it never adds load while we're backing off.
+    if (!hedge && cfg.hedge && latency.count() >= quint64(cfg.hedgeMinSamples)) {
+        const qint64 waitMs = std::max(qint64(cfg.hedgeMinMs), latency.percentile(0.95) / 1000000);
+        QTimer::singleShot(int(std::min(waitMs, qint64(cfg.timeoutMs > 0 ? cfg.timeoutMs : waitMs))), this, [this,id,req]{
+            if (!attempts.contains(id) || req->finished || req->live != 1 || inFlight >= concurrency()) return;
+            Perf::count(Perf::Hedges);
+            startAttempt(req, true);
+        });
+    }
+}
+
+void Fetcher::sendQt(quint64 id, Attempt & a)
+{
+    QNetworkRequest nr(a.req->url);
+    if (!a.req->etag.isEmpty()) nr.setRawHeader("If-None-Match", a.req->etag);
+    // QNetworkAccessManager asks for gzip itself but then decodes it out of sight; asking
+    // explicitly hands us the compressed bytes, which are counted and decoded in receiveQt()
+    nr.setRawHeader("Accept-Encoding", cfg.compress ? "gzip, deflate" : "identity");
+    if (a.req->url.scheme() == "https") {
+        nr.setSslConfiguration(tls);
+        a.ticketOffered = !tls.sessionTicket().isEmpty();
+        // QNetworkAccessManager doesn't say which connection a request gets. Until an attempt has
+        // finished, though, every open connection is either busy or one warmUp() opened.
+        a.warmCandidate = id <= quint64(warmed) && !attemptsDone;
+    }
+    QNetworkReply *r = a.reply = mgr.get(nr);
+    connect(r, &QNetworkReply::encrypted, this, [this,id,r]{
+        auto it = attempts.find(id);
+        if (it == attempts.end()) return; // a late signal after the attempt was given up on
+        it->encrypted = Perf::nowNs();
+        it->setupNs = it->encrypted - it->start;
+        const QSslConfiguration c = r->sslConfiguration();
+        noteTicket(c.sessionTicket(), c.sessionTicketLifeTimeHint());
+    });
+    connect(r, &QNetworkReply::metaDataChanged, this, [this,id]{
+        auto it = attempts.find(id);
+        if (it == attempts.end()) return;
+        if (!it->firstByte) it->firstByte = Perf::nowNs();
+    });
+    connect(r, &QIODevice::readyRead, this, [this,id,r]{
+        auto it = attempts.find(id);
+        if (it == attempts.end()) return;
+        receiveQt(*it, r);
+    });
+    connect(r, &QNetworkReply::finished, this, [this,id,r]{
+        r->deleteLater();
+        auto it = attempts.find(id);
+        if (it == attempts.end()) return;
+        receiveQt(*it, r);
+        if (it->warmCandidate && !it->encrypted) ++warmHits;
+        if (it->ticketOffered || it->encrypted) { // TLS 1.3 servers send tickets after the handshake
+            const QSslConfiguration c = r->sslConfiguration();
+            noteTicket(c.sessionTicket(), c.sessionTicketLifeTimeHint());
+        }
+        Outcome o;
+        o.status = r->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (r->error() != QNetworkReply::NoError)
+            o.error = QString("network error %1 (%2)").arg(int(r->error())).arg(r->errorString());
+        else if (!it->decodeError.isEmpty())
+            o.error = "bad compressed body: " + it->decodeError;
+        else if (it->inflate && !it->inflate->finished())
+            o.error = "compressed body ends early";
+        o.etag = r->rawHeader("ETag");
+        o.retryAfterSecs = r->rawHeader("Retry-After").toInt();
+        attemptFinished(id, o);
+    });
+}
+
+void Fetcher::receiveQt(Attempt & a, QNetworkReply *r)
+{
+    const qint64 avail = r->bytesAvailable();
+    if (avail <= 0) return;
+    if (!a.wireBytes) {
+        const QByteArray encoding = r->rawHeader("Content-Encoding");
+        if (Inflater::supports(encoding)) {
+            a.inflate = std::make_shared<Inflater>();
+            a.inflate->begin(encoding);
+        }
+        // sized from Content-Length, a plain body is read in place without the buffer growing
+        const qint64 length = r->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+        a.data = bodies.take(a.inflate ? 0 : int(std::min(length, qint64(1) << 30)));
+    }
+    // read straight into the body (or, compressed, into a reused scratch buffer) rather than
+    // through readAll()'s temporary
+    QByteArray & into = a.inflate ? scratch : a.data;
+    const int at = a.inflate ? 0 : into.size();
+    into.resize(at + int(avail));
+    const qint64 n = std::max(r->read(into.data() + at, avail), qint64(0));
+    into.resize(at + int(n));
+    a.wireBytes += n;
+    if (a.inflate && a.decodeError.isEmpty() && !a.inflate->feed(scratch.constData(), int(n), a.data))
+        a.decodeError = a.inflate->error();
+}
+
+HttpClient & Fetcher::leanClient()
+{
+    if (!client) {
+        client.reset(new HttpClient(cfg.http));
+        client->setSessionTicket(tls.sessionTicket());
+        client->setBufferPool(&bodies);
+    }
+    return *client;
+}
+
+void Fetcher::sendLean(quint64 id, Attempt & a)
+{
+    const QByteArray headers = a.req->etag.isEmpty() ? QByteArray() : "If-None-Match: " + a.req->etag + "\r\n";
+    a.leanId = leanClient().get(a.req->url, headers, [this,id](HttpClient::Response & r){
+        auto it = attempts.find(id);
+        if (it == attempts.end()) return;
+        it->data = std::move(r.body);
+        it->wireBytes = r.wireBytes;
+        it->encrypted = r.connected > it->start ? r.connected : 0; // a warmed-up connection may have been ready first
+        it->firstByte = r.firstByte;
+        it->setupNs = r.setupNs;
+        it->setupSaved = r.setupSaved;
+        it->ticketOffered = r.ticketOffered;
+        if (r.setupSaved > 0) ++warmHits;
+        noteTicket(client->sessionTicket(), 0);
+        Outcome o;
+        o.status = r.status;
+        if (!r.error.isEmpty()) o.error = QString("network error (%1)").arg(r.error);
+        else if (r.status >= 400) o.error = QString("HTTP %1").arg(r.status);
+        o.etag = r.headers.value("etag");
+        o.retryAfterSecs = r.headers.value("retry-after").toInt();
+        attemptFinished(id, o);
+    });
+}
+
+void Fetcher::abortAttempt(const Attempt & a)
+{
+    // either way the attempt is reported finished (with an error) before this returns
+    if (a.reply) a.reply->abort();
+    else if (client) client->abort(a.leanId);
+}
+
+void Fetcher::attemptFinished(quint64 id, const Outcome & o)
+{
+    TRACE_SCOPE("attemptFinished");
+    Attempt a = attempts.take(id);
+    ++attemptsDone;
+    TRACE_ASYNC_END(a.hedge ? "hedge" : "reply", id);
+    std::shared_ptr<Request> req = a.req;
+    --req->live;
+    Perf::setGauge(Perf::RequestsInFlight, --inFlight);
+    if (req->finished) { // a loser of a hedged race, aborted below
+        bodies.give(a.data);
+        pump();
+        return;
+    }
+    const qint64 done = Perf::nowNs();
+
+    if (o.error.isEmpty()) {
+        req->finished = true;
+        if (a.hedge) Perf::count(Perf::HedgeWins);
+        QList<Attempt> losers;
+        for (auto it = attempts.begin(); it != attempts.end(); ++it)
+            if (it->req == req) losers.append(*it);
+        for (const Attempt & l : losers)
+            abortAttempt(l); // re-enters attemptFinished, which drops it since req->finished is set
+        recordTimings(a, done, a.data.size());
+        Perf::record(Perf::Request, done - req->start);
+        const qint64 lat = done - a.start;
+        latency.add(lat);
+        if (nLatency >= 4 && double(lat) > cfg.spikeFactor * avgLatency)
+            decrease(a.start);
+        else
+            increase(lat);
+        req->done(o.status, a.data, o.etag);
+        bodies.give(a.data); // unless the consumer kept the page
+        pump();
+        return;
+    }
+
+    bodies.give(a.data);
+    const QString err = a.timedOut ? QString("timed out after %1 ms").arg(cfg.timeoutMs) : o.error;
+    if (a.timedOut) Perf::count(Perf::Timeouts);
+    if (a.timedOut || congested(o.status)) decrease(a.start);
+    if (req->live > 0) { // its twin is still running
+        pump();
+        return;
+    }
+    ++req->failures;
+    if (!retryable(o.status) || req->failures > cfg.maxRetries) {
+        req->finished = true;
+        req->fail(QString("%1 after %2 attempt(s): %3").arg(req->url.toString()).arg(req->failures).arg(err));
+        pump();
+        return;
+    }
+    // honour the server's Retry-After (in seconds) when it asks for longer than our own backoff
+    const int delay = std::max(backoffDelay(req->failures), o.retryAfterSecs * 1000);
+    Log() << "Request for " << req->url.toString() << " failed: " << err << ", retrying in " << delay << " ms";
+    Perf::count(Perf::Retries);
+    QTimer::singleShot(delay, this, [this,req]{
+        pending.prepend(req); // retries go ahead of requests that haven't been tried yet
+        pump();
+    });
+    pump();
+}
+
+void Fetcher::increase(qint64 latencyNs)
+{
+    avgLatency = nLatency++ ? 0.9*avgLatency + 0.1*double(latencyNs) : double(latencyNs);
+    const int before = concurrency();
+    limit = std::min(double(cfg.maxConcurrency), limit + 1./limit); // about +1 per round trip
+    if (concurrency() != before) Perf::sample(Perf::Concurrency, concurrency());
+}
+
+void Fetcher::decrease(qint64 attemptStart)
+{
+    // attempts already in flight at the last cut saw the same congestion; don't cut again for them
+    if (attemptStart < lastDecrease) return;
+    lastDecrease = Perf::nowNs();
+    const int before = concurrency();
+    limit = std::max(1., limit / 2.);
+    if (concurrency() != before) Perf::sample(Perf::Concurrency, concurrency());
+}
+
+void Fetcher::recordTimings(const Attempt & a, qint64 done, qint64 bodySize)
+{
+    // Qt doesn't expose DNS/TCP separately; the encrypted() signal marks the end of connection setup
+    if (a.encrypted) Perf::record(Perf::Connect, a.encrypted - a.start);
+    const qint64 sent = a.encrypted ? a.encrypted : a.start, firstByte = a.firstByte ? a.firstByte : done;
+    Perf::record(Perf::FirstByte, firstByte - sent);
+    Perf::record(Perf::Transfer, done - firstByte);
+    Perf::addBytes(bodySize);
+    Perf::addWireBytes(a.wireBytes);
+    if (a.setupNs > 0) {
+        SetupStats & s = a.ticketOffered ? ticketSetups : fullSetups;
+        ++s.n;
+        s.ns += a.setupNs;
+        warmSavedNs += a.setupSaved;
+    }
+}
+
+void Fetcher::warmUp(const QUrl & url)
+{
+    const bool https = url.scheme() == "https";
+    const int n = cfg.lean ? std::min(cfg.http.connections, cfg.maxConcurrency) : std::min(cfg.maxConcurrency, 6);
+    warmed = n;
+    const qint64 t0 = Perf::nowNs();
+    // connect once the name is resolved, so the connections find it in Qt's host cache
+    QHostInfo::lookupHost(url.host(), this, [this,url,https,n,t0](const QHostInfo &){
+        resolveNs = Perf::nowNs() - t0;
+        if (cfg.lean) {
+            leanClient().preconnect(url, n);
+            return;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (https) mgr.connectToHostEncrypted(url.host(), quint16(url.port(443)), tls);
+            else mgr.connectToHost(url.host(), quint16(url.port(80)));
+        }
+    });
+}
+
+void Fetcher::setSessionCache(const QString & fileName, const QUrl & url)
+{
+    QString err;
+    if (!privateDir(QFileInfo(fileName).absolutePath(), &err)) {
+        Log() << "Not keeping TLS sessions: " << err;
+        return;
+    }
+    sessionFile = fileName;
+    sessionHost = url.host().toUtf8();
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly)) return; // no session saved yet
+    const QJsonObject o = QJsonDocument::fromJson(f.readAll()).object();
+    if (o.value("host").toString().toUtf8() != sessionHost) return;
+    if (qint64(o.value("expires").toDouble()) <= QDateTime::currentMSecsSinceEpoch()) return;
+    const QByteArray ticket = QByteArray::fromBase64(o.value("ticket").toString().toLatin1());
+    tls.setSessionTicket(ticket);
+    if (client) client->setSessionTicket(ticket);
+}
+
+void Fetcher::noteTicket(const QByteArray & ticket, int lifetimeSecs)
+{
+    if (ticket.isEmpty() || ticket == tls.sessionTicket()) return;
+    tls.setSessionTicket(ticket);
+    if (client) client->setSessionTicket(ticket);
+    if (sessionFile.isEmpty()) return;
+    QJsonObject o;
+    o["host"] = QString::fromUtf8(sessionHost);
+    o["ticket"] = QString::fromLatin1(ticket.toBase64());
+    o["expires"] = double(QDateTime::currentMSecsSinceEpoch() + 1000ll * (lifetimeSecs > 0 ? lifetimeSecs : DefaultTicketLifetimeSecs));
+    // Written to a temporary file in the (private) directory and renamed over the old one, so the
+    // ticket is never readable by others, nor left half-written. Owner-only all the same, in
+    // case the file is copied elsewhere.
+    QSaveFile f(sessionFile);
+    const QByteArray json = QJsonDocument(o).toJson(QJsonDocument::Compact);
+    if (!f.open(QIODevice::WriteOnly) || !f.setPermissions(QFileDevice::ReadOwner|QFileDevice::WriteOwner)
+            || f.write(json) != json.size() || !f.commit()) {
+        Log() << "Could not save the TLS session to " << sessionFile << ": " << f.errorString();
+        sessionFile.clear();
+        return;
+    }
+    sessionSaved = true;
+}
+
+QStringList Fetcher::connectionSummary() const
+{
+    QStringList ret;
+    if (warmed) {
+        QString line = QString("Warm-up: %1 connection(s) opened ahead of the requests").arg(warmed);
+        if (resolveNs >= 0) line += QString().sprintf(", host resolved in %.1f ms", double(resolveNs) / 1e6);
+        ret << line;
+        if (cfg.lean)
+            ret << QString().sprintf("  %d request(s) found one ready or under way, and didn't wait %.1f ms of connection setup",
+                                     warmHits, double(warmSavedNs) / 1e6);
+        else if (warmHits && fullSetups.n)
+            // a warmed-up connection may still have been mid-handshake when its request went out
+            ret << QString().sprintf("  %d request(s) went out on a warmed-up connection, up to %.1f ms saved at %.1f ms per inline setup",
+                                     warmHits, warmHits * fullSetups.meanMs(), fullSetups.meanMs());
+        else if (warmHits)
+            ret << QString().sprintf("  %d request(s) went out on a warmed-up connection", warmHits);
+    }
+    if (fullSetups.n || ticketSetups.n) {
+        ret << QString().sprintf("Connection setups: %d full (mean %.1f ms), %d offering a saved TLS session (mean %.1f ms)",
+                                 fullSetups.n, fullSetups.meanMs(), ticketSetups.n, ticketSetups.meanMs());
+        if (fullSetups.n && ticketSetups.n && fullSetups.meanMs() > ticketSetups.meanMs())
+            ret << QString().sprintf("  session reuse saved about %.1f ms", ticketSetups.n * (fullSetups.meanMs() - ticketSetups.meanMs()));
+    }
+    if (sessionSaved) ret << "TLS session saved to " + sessionFile + " for the next run";
+    return ret;
+}
+
+int Fetcher::backoffDelay(int failures) const
+{
+    // "equal jitter": half the exponential delay is fixed, the other half random, so retries
+    // from many requests spread out without any of them coming back immediately
+    const qint64 exp = std::min(qint64(cfg.backoffMaxMs), qint64(cfg.backoffMs) << std::min(failures - 1, 20));
+    return int(exp/2 + QRandomGenerator::global()->bounded(exp/2 + 1));
+}
+
+bool Fetcher::retryable(int status)
+{
+    // 4xx means the request itself is wrong and will fail the same way again; 429 is the exception
+    return !(status >= 400 && status < 500 && status != 429);
+}
+
+bool Fetcher::congested(int status)
+{
+    return status == 429 || status >= 500;
+}
@@ -0,0 +1,184 @@
+#ifndef FETCHER_H
+#define FETCHER_H
+
+#include <QObject>
+#include <QNetworkAccessManager>
+#include <QSslConfiguration>
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QUrl>
+#include <QHash>
+#include <QList>
+#include <functional>
+#include <memory>
+#include "Perf.h"
+#include "HttpClient.h"
+#include "Inflate.h"
+#include "BufferPool.h"
+
+class QNetworkReply;
+
+/// GETs pages with per-attempt timeouts, bounded retries with jittered exponential backoff,
+/// and hedging: once a request has run past the p95 of the latencies seen so far, a duplicate
+/// is sent and whichever answers first wins. Only when every retry is used up is the request
+/// reported as failed.
+///
+/// Requests queue up and are sent no faster than a token bucket allows, with at most
+/// concurrency() in flight. The concurrency limit is AIMD-controlled: it grows by about one
+/// per round trip while latency stays near its running average, and halves on HTTP 429/5xx,
+/// timeouts or a latency spike (at most once per round trip).
+///
+/// Per-request timings (connect, first byte, transfer, whole request) go into Perf, as does
+/// the concurrency limit over time.
+///
+/// Requests go through QNetworkAccessManager, or with Config::lean through an HttpClient with
+/// its own connection pool and optional pipelining. With Config::compress, gzip or deflate
+/// bodies are asked for and decoded as they arrive; Perf gets both the compressed and the
+/// decoded byte counts. Bodies are read into buffers from a BufferPool, sized from
+/// Content-Length where there is one.
+///
+/// warmUp() resolves the host and opens connections before there is anything to send, and TLS
+/// sessions are kept so that later handshakes (with setSessionCache(), also those of the next
+/// run) can be abbreviated. connectionSummary() reports what either saved.
+class Fetcher : public QObject
+{
+public:
+    struct Config
+    {
+        int timeoutMs = 60000;     // per attempt, 0 = none
+        int maxRetries = 6;        // attempts after the first one before giving up
+        int backoffMs = 500;       // delay before the first retry; doubles for each further one
+        int backoffMaxMs = 30000;
+        bool hedge = true;
+        int hedgeMinSamples = 8;   // completed requests needed before the p95 is trusted
+        int hedgeMinMs = 100;      // never hedge sooner than this
+        double rate = 10.;         // requests per second, 0 = unlimited
+        int burst = 0;             // token bucket size, 0 = one second's worth
+        int initialConcurrency = 2;
+        int maxConcurrency = 6;    // QNetworkAccessManager opens at most 6 connections per host anyway
+        double spikeFactor = 2.;   // latency above this multiple of the running average counts as congestion
+        bool lean = false;         // use HttpClient instead of QNetworkAccessManager
+        bool compress = true;      // ask for gzip/deflate bodies
+        HttpClient::Config http;   // with lean: connections per host and pipelining
+    };
+
+    typedef std::function<void(const QByteArray & body)> DoneFn;
+    typedef std::function<void(const QString & error)> FailFn;
+    /// status is 304 (and body empty) when the resource still matches the etag that was sent.
+    typedef std::function<void(int status, const QByteArray & body, const QByteArray & etag)> ConditionalFn;
+
+    explicit Fetcher(const Config & c, QObject *parent = nullptr);
+
+    const Config & config() const { return cfg; }
+    int concurrency() const { return int(limit); }
+    /// Queues a GET. Exactly one of done or fail is called later, from the event loop.
+    /// tag labels the trace spans.
+    void get(const QUrl & url, qint64 tag, const DoneFn & done, const FailFn & fail);
+    /// Like get(), but sends If-None-Match: etag (if not empty) and hands back the response's ETag.
+    void getConditional(const QUrl & url, const QByteArray & etag, qint64 tag, const ConditionalFn & done, const FailFn & fail);
+    /// While held, queued requests wait instead of starting (backpressure from whatever consumes
+    /// the pages); requests already in flight finish normally.
+    void setHold(bool h);
+    /// Resolves url's host and opens as many connections to it as the requests can use, ahead
+    /// of the first request.
+    void warmUp(const QUrl & url);
+    /// Offers the TLS session saved in fileName by an earlier run, if it's for the same host and
+    /// hasn't expired, and saves newer sessions there. A ticket resumes the session, so fileName's
+    /// directory must be the owner's alone: it is created that way if missing, and if it exists
+    /// with access for anyone else, nothing is read or saved.
+    void setSessionCache(const QString & fileName, const QUrl & url);
+    /// Warm-up and TLS handshake figures for the run summary; empty if there's nothing to say.
+    QStringList connectionSummary() const;
+
+private:
+    struct Request
+    {
+        QUrl url;
+        qint64 tag = 0;
+        qint64 start = 0;      // Perf::nowNs() when queued
+        int failures = 0;
+        int live = 0;          // attempts in flight
+        bool finished = false;
+        QByteArray etag;       // sent as If-None-Match
+        ConditionalFn done;
+        FailFn fail;
+    };
+    struct Attempt
+    {
+        std::shared_ptr<Request> req;
+        QNetworkReply *reply = nullptr; // or, with cfg.lean, the HttpClient request
+        HttpClient::Id leanId = 0;
+        QByteArray data;                  // decoded body
+        qint64 wireBytes = 0;             // body bytes as received
+        std::shared_ptr<Inflater> inflate; // QNetworkAccessManager: the body has a Content-Encoding
+        QString decodeError;
+        qint64 start = 0, encrypted = 0, firstByte = 0; // Perf::nowNs() timestamps, 0 = not reached
+        qint64 setupNs = 0, setupSaved = 0; // a new connection's setup, and how much of it warmUp() took off this request
+        bool hedge = false, timedOut = false, ticketOffered = false;
+        bool warmCandidate = false;       // QNetworkAccessManager: any ready connection it finds is a warmed-up one
+    };
+    struct SetupStats
+    {
+        int n = 0;
+        qint64 ns = 0;
+        double meanMs() const { return n ? double(ns) / double(n) / 1e6 : 0.; }
+    };
+    /// How an attempt ended, whichever client made it.
+    struct Outcome
+    {
+        int status = 0;
+        QString error;         // empty on success
+        QByteArray etag;
+        int retryAfterSecs = 0;
+    };
+
+    void enqueue(const QUrl & url, const QByteArray & etag, qint64 tag, const ConditionalFn & done, const FailFn & fail);
+    void pump();
+    bool takeToken();
+    void startAttempt(const std::shared_ptr<Request> & req, bool hedge);
+    void sendQt(quint64 id, Attempt & a);
+    void sendLean(quint64 id, Attempt & a);
+    void receiveQt(Attempt & a, QNetworkReply *r);
+    HttpClient & leanClient();
+    void noteTicket(const QByteArray & ticket, int lifetimeSecs);
+    void abortAttempt(const Attempt & a);
+    void attemptFinished(quint64 id, const Outcome & o);
+    void recordTimings(const Attempt & a, qint64 done, qint64 bodySize);
+    void increase(qint64 latencyNs);
+    void decrease(qint64 attemptStart);
+    int backoffDelay(int failures) const;
+    static bool retryable(int status);
+    static bool congested(int status);
+
+    Config cfg;
+    QNetworkAccessManager mgr;
+    std::unique_ptr<HttpClient> client; // created on first use with cfg.lean
+    QHash<quint64, Attempt> attempts;
+    BufferPool bodies;          // reply bodies, recycled once their consumer is done with them
+    QByteArray scratch;         // QNetworkAccessManager: compressed bytes on their way to the inflater
+    quint64 nextAttempt = 1;
+    QSslConfiguration tls;      // for QNetworkAccessManager requests; carries the latest session ticket
+    QString sessionFile;
+    QByteArray sessionHost;
+    bool sessionSaved = false;
+    int warmed = 0;             // connections opened by warmUp(), used by the first attempts
+    qint64 resolveNs = -1;
+    int warmHits = 0;           // attempts that found a warmed-up connection
+    quint64 attemptsDone = 0;   // once one is, its connection may be reused: no longer a warm-up hit
+    qint64 warmSavedNs = 0;     // setup time they didn't wait for (HttpClient only; QNAM doesn't show its connections)
+    SetupStats fullSetups, ticketSetups; // new connections set up inline, without and with a session ticket offered
+    QList<std::shared_ptr<Request>> pending;
+    int inFlight = 0;
+    bool pumpScheduled = false;
+    bool held = false;
+    double tokens = 0.;
+    qint64 tokensAt = 0;        // Perf::nowNs() of the last refill
+    double limit = 1.;          // AIMD concurrency limit; requests are sent while inFlight < int(limit)
+    double avgLatency = 0.;     // EWMA of successful attempt latencies, ns
+    quint64 nLatency = 0;
+    qint64 lastDecrease = 0;    // attempts started before this don't trigger another cut
+    Perf::Histogram latency;    // of successful requests, for the hedge threshold
+};
+
+#endif // FETCHER_H
@@ -0,0 +1,406 @@
+#include "HttpClient.h"
+#include <QSslSocket>
+#include <QSslConfiguration>
+#include <QTimer>
+#include <algorithm>
+#include <iterator>
+#include "Perf.h"
+#include "BufferPool.h"
+
+namespace {
+    const int InitialBuffer = 64*1024;
+    const int MaxLine = 64*1024;          // status, header and chunk size lines
+    const qint64 MaxBody = 1ll << 30;     // QByteArray's limit
+}
+
+HttpClient::HttpClient(const Config & c, QObject *parent) : QObject(parent), cfg(c)
+{
+    if (cfg.connections < 1) cfg.connections = 1;
+    if (cfg.pipelining < 1) cfg.pipelining = 1;
+}
+
+HttpClient::~HttpClient()
+{
+    // the sockets would otherwise be deleted as our children, and report their close to us
+    QList<ConnPtr> all;
+    for (const QList<ConnPtr> & pool : pools) all += pool;
+    for (const ConnPtr & c : all) teardown(c);
+}
+
+QByteArray HttpClient::hostKey(const QUrl & url)
+{
+    const int port = url.port(url.scheme() == "https" ? 443 : 80);
+    const QByteArray host = url.scheme().toLatin1() + "://" + url.host(QUrl::FullyEncoded).toLatin1() + ":" + QByteArray::number(port);
+    if (!origins.contains(host)) origins.insert(host, url);
+    return host;
+}
+
+HttpClient::Id HttpClient::get(const QUrl & url, const QByteArray & extraHeaders, const DoneFn & done)
+{
+    const QByteArray host = hostKey(url);
+    const QByteArray hostName = url.host(QUrl::FullyEncoded).toLatin1();
+    Request r;
+    r.id = nextId++;
+    r.queuedAt = Perf::nowNs();
+    QByteArray target = url.path(QUrl::FullyEncoded).toLatin1();
+    if (target.isEmpty()) target = "/";
+    if (url.hasQuery()) target += "?" + url.query(QUrl::FullyEncoded).toLatin1();
+    r.head = "GET " + target + " HTTP/1.1\r\nHost: " + hostName;
+    if (url.port() >= 0) r.head += ":" + QByteArray::number(url.port());
+    r.head += "\r\n";
+    if (cfg.compress) r.head += "Accept-Encoding: gzip, deflate\r\n";
+    r.head += extraHeaders;
+    r.head += "\r\n";
+    r.done = done;
+    const Id id = r.id;
+    waiting[host].push_back(std::move(r));
+    dispatch(host);
+    return id;
+}
+
+void HttpClient::abort(Id id)
+{
+    Response resp;
+    resp.error = "aborted";
+    for (auto w = waiting.begin(); w != waiting.end(); ++w)
+        for (auto it = w->begin(); it != w->end(); ++it)
+            if (it->id == id) {
+                const DoneFn done = std::move(it->done);
+                w->erase(it);
+                done(resp);
+                return;
+            }
+    ConnPtr c;
+    for (const QList<ConnPtr> & pool : pools)
+        for (const ConnPtr & p : pool)
+            for (const Request & r : p->sent)
+                if (r.id == id) c = p;
+    if (!c) return; // already answered
+    std::deque<Request> sent;
+    sent.swap(c->sent);
+    teardown(c);
+    DoneFn done;
+    std::deque<Request> & q = waiting[c->host];
+    for (auto it = sent.rbegin(); it != sent.rend(); ++it) {
+        if (it->id == id) done = std::move(it->done);
+        else q.push_front(std::move(*it));
+    }
+    done(resp);
+    dispatch(c->host);
+}
+
+void HttpClient::preconnect(const QUrl & url, int n)
+{
+    const QByteArray host = hostKey(url);
+    for (int i = pools.value(host).size(); i < std::min(n, cfg.connections); ++i)
+        open(host)->preconnected = true;
+}
+
+void HttpClient::dispatch(const QByteArray & host)
+{
+    auto w = waiting.find(host);
+    if (w == waiting.end()) return;
+    std::deque<Request> & q = *w;
+    QList<ConnPtr> & pool = pools[host];
+    while (!q.empty()) {
+        // the least busy connection, or a new one if every connection is busy and there's room
+        ConnPtr best;
+        for (const ConnPtr & c : pool)
+            if (!c->closeAfter && (!best || c->sent.size() < best->sent.size())) best = c;
+        if (!best || (!best->sent.empty() && pool.size() < cfg.connections)) best = open(host);
+        else if (int(best->sent.size()) >= cfg.pipelining) break;
+        send(best, std::move(q.front()));
+        q.pop_front();
+    }
+}
+
+HttpClient::ConnPtr HttpClient::open(const QByteArray & host)
+{
+    ConnPtr c = std::make_shared<Conn>();
+    c->host = host;
+    c->in.reserve(InitialBuffer); // once reserved, emptying the buffer keeps the allocation
+    c->openedAt = Perf::nowNs();
+    QSslSocket *s = c->sock = new QSslSocket(this);
+    const QUrl origin = origins.value(host);
+    const bool tls = origin.scheme() == "https";
+    if (tls) {
+        // Qt forgets sessions by default; keeping them lets the ticket be reused by the next
+        // connection (and, through Fetcher's session cache, the next run)
+        QSslConfiguration conf = s->sslConfiguration();
+        conf.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+        if (!ticket.isEmpty()) {
+            conf.setSessionTicket(ticket);
+            c->ticketOffered = true;
+        }
+        s->setSslConfiguration(conf);
+    }
+    auto onConnected = [this,c,tls]{
+        c->ready = true;
+        c->connectedAt = Perf::nowNs();
+        if (tls) {
+            const QByteArray t = c->sock->sslConfiguration().sessionTicket();
+            if (!t.isEmpty()) ticket = t;
+        }
+        c->sock->setSocketOption(QAbstractSocket::LowDelayOption, 1); // requests are small; don't let Nagle hold them
+        for (const Request & r : c->sent)
+            c->sock->write(r.head);
+    };
+    if (tls) connect(s, &QSslSocket::encrypted, this, onConnected);
+    else connect(s, &QAbstractSocket::connected, this, onConnected);
+    connect(s, &QIODevice::readyRead, this, [this,c]{ onReadyRead(c); });
+    connect(s, &QAbstractSocket::stateChanged, this, [this,c](QAbstractSocket::SocketState st){
+        if (st != QAbstractSocket::UnconnectedState) return;
+        onReadyRead(c); // whatever arrived before the close
+        if (c->sock) closed(c, c->sock->errorString());
+    });
+    pools[host].append(c);
+    // connect from the event loop, so a connection that fails at once can't call back into get()
+    QTimer::singleShot(0, s, [s,origin,tls]{
+        if (tls) s->connectToHostEncrypted(origin.host(), quint16(origin.port(443)));
+        else s->connectToHost(origin.host(), quint16(origin.port(80)));
+    });
+    return c;
+}
+
+void HttpClient::send(const ConnPtr & c, Request && r)
+{
+    if (c->ready) c->sock->write(r.head);
+    c->sent.push_back(std::move(r));
+}
+
+void HttpClient::onReadyRead(const ConnPtr & c)
+{
+    if (!c->sock) return;
+    const qint64 avail = c->sock->bytesAvailable();
+    if (avail <= 0) return;
+    // read straight into the buffer, dropping what has been parsed without giving up its capacity
+    if (c->pos == c->in.size()) {
+        c->in.resize(0);
+        c->pos = 0;
+    } else if (c->pos > c->in.size() / 2) {
+        c->in.remove(0, c->pos);
+        c->pos = 0;
+    }
+    const int at = c->in.size();
+    c->in.resize(at + int(avail));
+    const qint64 n = c->sock->read(c->in.data() + at, avail);
+    c->in.resize(at + int(std::max(n, qint64(0))));
+    while (c->sock && parse(c)) {}
+}
+
+bool HttpClient::readLine(Conn & c, QByteArray & line)
+{
+    const int nl = c.in.indexOf('\n', c.pos);
+    if (nl < 0) return false;
+    line = c.in.mid(c.pos, nl - c.pos);
+    if (line.endsWith('\r')) line.chop(1);
+    c.pos = nl + 1;
+    return true;
+}
+
+bool HttpClient::parse(const ConnPtr & c)
+{
+    Conn & k = *c;
+    if (k.pos == k.in.size()) return false;
+    if (k.sent.empty()) {
+        closed(c, "data without a request");
+        return false;
+    }
+    auto needMore = [&]{
+        if (k.in.size() - k.pos > MaxLine) closed(c, "line too long");
+        return false;
+    };
+    QByteArray line;
+    switch (k.state) {
+    case Conn::StatusLine:
+        if (!k.resp.firstByte) k.resp.firstByte = Perf::nowNs();
+        if (!readLine(k, line)) return needMore();
+        if (line.isEmpty()) return true; // stray CRLF between responses
+        if (!line.startsWith("HTTP/1.") || line.size() < 12) {
+            closed(c, "malformed status line");
+            return false;
+        }
+        k.resp.status = line.mid(9, 3).toInt();
+        k.closeAfter = line.startsWith("HTTP/1.0");
+        k.state = Conn::Headers;
+        return true;
+
+    case Conn::Headers: {
+        if (!readLine(k, line)) return needMore();
+        if (!line.isEmpty()) {
+            const int colon = line.indexOf(':');
+            if (colon > 0) {
+                const QByteArray name = line.left(colon).trimmed().toLower(), value = line.mid(colon + 1).trimmed();
+                if (name == "connection") {
+                    const QByteArray v = value.toLower();
+                    if (v.contains("close")) k.closeAfter = true;
+                    else if (v.contains("keep-alive")) k.closeAfter = false;
+                }
+                k.resp.headers.insert(name, value);
+            }
+            return true;
+        }
+        const int status = k.resp.status;
+        if (status >= 100 && status < 200) { // interim response; the real one follows
+            const qint64 firstByte = k.resp.firstByte;
+            k.resp = Response();
+            k.resp.firstByte = firstByte;
+            k.state = Conn::StatusLine;
+            return true;
+        }
+        if (status == 204 || status == 304) {
+            complete(c);
+            return true;
+        }
+        const QByteArray encoding = k.resp.headers.value("content-encoding");
+        if (!encoding.isEmpty() && encoding.toLower() != "identity") {
+            k.inflate.reset(new Inflater);
+            if (!k.inflate->begin(encoding)) {
+                closed(c, "unsupported Content-Encoding " + QString::fromLatin1(encoding));
+                return false;
+            }
+        }
+        if (k.resp.headers.value("transfer-encoding").toLower().contains("chunked")) {
+            if (bodies) k.resp.body = bodies->take(0);
+            k.state = Conn::ChunkSize;
+            return true;
+        }
+        if (k.resp.headers.contains("content-length")) {
+            bool ok;
+            k.remaining = k.resp.headers.value("content-length").toLongLong(&ok);
+            if (!ok || k.remaining < 0 || k.remaining > MaxBody) {
+                closed(c, "bad Content-Length");
+                return false;
+            }
+            if (bodies && k.remaining) k.resp.body = bodies->take(k.inflate ? 0 : int(k.remaining));
+            else if (!k.inflate) k.resp.body.reserve(int(k.remaining));
+            k.state = Conn::Body;
+            if (!k.remaining) complete(c);
+            return true;
+        }
+        if (bodies) k.resp.body = bodies->take(0);
+        k.state = Conn::UntilClose;
+        k.closeAfter = true;
+        return true;
+    }
+
+    case Conn::Body:
+    case Conn::ChunkData: {
+        const int n = int(std::min(k.remaining, qint64(k.in.size() - k.pos)));
+        if (!appendBody(c, k.in.constData() + k.pos, n)) return false;
+        k.pos += n;
+        k.remaining -= n;
+        if (k.remaining) return false;
+        if (k.state == Conn::Body) complete(c);
+        else k.state = Conn::ChunkEnd;
+        return true;
+    }
+
+    case Conn::ChunkSize: {
+        if (!readLine(k, line)) return needMore();
+        const int semi = line.indexOf(';'); // chunk extensions are ignored
+        bool ok;
+        const qint64 n = (semi < 0 ? line : line.left(semi)).trimmed().toLongLong(&ok, 16);
+        if (!ok || n < 0 || k.resp.wireBytes + n > MaxBody) {
+            closed(c, "bad chunk size");
+            return false;
+        }
+        k.remaining = n;
+        k.state = n ? Conn::ChunkData : Conn::Trailers;
+        return true;
+    }
+
+    case Conn::ChunkEnd:
+        if (!readLine(k, line)) return needMore();
+        k.state = Conn::ChunkSize;
+        return true;
+
+    case Conn::Trailers:
+        if (!readLine(k, line)) return needMore();
+        if (line.isEmpty()) complete(c);
+        return true;
+
+    case Conn::UntilClose:
+        if (!appendBody(c, k.in.constData() + k.pos, k.in.size() - k.pos)) return false;
+        k.pos = k.in.size();
+        return false;
+    }
+    return false;
+}
+
+bool HttpClient::appendBody(const ConnPtr & c, const char *data, int n)
+{
+    Conn & k = *c;
+    k.resp.wireBytes += n;
+    if (!k.inflate) {
+        k.resp.body.append(data, n);
+        return true;
+    }
+    if (k.inflate->feed(data, n, k.resp.body)) return true;
+    closed(c, "bad compressed body: " + k.inflate->error());
+    return false;
+}
+
+void HttpClient::complete(const ConnPtr & c)
+{
+    Request r = std::move(c->sent.front());
+    c->sent.pop_front();
+    Response resp = std::move(c->resp);
+    resp.connected = c->connectedAt;
+    if (c->connectedAt) {
+        resp.setupNs = c->connectedAt - c->openedAt;
+        resp.ticketOffered = c->ticketOffered;
+        if (c->preconnected) resp.setupSaved = std::max(qint64(0), std::min(resp.setupNs, r.queuedAt - c->openedAt));
+        // TLS 1.3 servers send the ticket after the handshake, so look again now
+        const QByteArray t = c->sock->sslConfiguration().sessionTicket();
+        if (!t.isEmpty()) ticket = t;
+    }
+    if (c->inflate && !c->inflate->finished()) resp.error = "compressed body ends early";
+    c->inflate.reset();
+    c->resp = Response();
+    c->state = Conn::StatusLine;
+    c->remaining = 0;
+    c->connectedAt = 0;
+    ++c->served;
+    const QByteArray host = c->host;
+    if (c->closeAfter) closed(c, QString());
+    r.done(resp);
+    dispatch(host);
+}
+
+void HttpClient::closed(const ConnPtr & c, const QString & error)
+{
+    std::deque<Request> sent;
+    sent.swap(c->sent);
+    Response resp = std::move(c->resp);
+    resp.connected = c->connectedAt;
+    const Conn::State state = c->state;
+    // A reused connection closed before any of its response arrived was most likely timed out
+    // by the server while idle; its request goes out again along with the ones behind it.
+    const bool stale = state == Conn::StatusLine && !resp.firstByte && c->served > 0;
+    teardown(c);
+    DoneFn done;
+    if (!sent.empty() && !stale) {
+        done = std::move(sent.front().done);
+        sent.pop_front();
+    }
+    // the rest were never answered, and GETs are safe to send again
+    std::deque<Request> & q = waiting[c->host];
+    q.insert(q.begin(), std::make_move_iterator(sent.begin()), std::make_move_iterator(sent.end()));
+    if (done) {
+        if (state != Conn::UntilClose) resp.error = error.isEmpty() ? QString("connection closed") : error;
+        done(resp); // for UntilClose, the close is how the body ends
+    }
+    dispatch(c->host);
+}
+
+void HttpClient::teardown(const ConnPtr & c)
+{
+    pools[c->host].removeOne(c);
+    if (!c->sock) return;
+    QSslSocket *s = c->sock;
+    c->sock = nullptr;
+    disconnect(s, nullptr, this, nullptr);
+    s->abort();
+    s->deleteLater();
+}
@@ -0,0 +1,128 @@
+#ifndef HTTPCLIENT_H
+#define HTTPCLIENT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QUrl>
+#include <QHash>
+#include <QList>
+#include <deque>
+#include <functional>
+#include <memory>
+#include "Inflate.h"
+
+class BufferPool;
+class QSslSocket;
+
+/// Lean HTTP/1.1 client for bulk GETs, which Fetcher can use in place of QNetworkAccessManager
+/// (--http lean): no per-request QObject or signals, and no fixed six connections per host.
+///
+/// Keeps up to Config::connections persistent connections per host. With pipelining > 1 further
+/// requests go down a busy connection without waiting for the responses ahead of them. Responses
+/// (Content-Length, chunked or read-until-close bodies) are parsed straight out of each
+/// connection's receive buffer, which keeps its capacity for the connection's lifetime. With
+/// Config::compress, gzip or deflate bodies are asked for and decoded as they arrive.
+///
+/// preconnect() opens connections ahead of the first request, so it doesn't pay for DNS, TCP
+/// and TLS inline. Every TLS connection offers the most recent session ticket, so after the
+/// first full handshake the rest are abbreviated; setSessionTicket() seeds it from an earlier run.
+///
+/// Plain http and https GETs only: no redirects, proxies or cookies.
+class HttpClient : public QObject
+{
+public:
+    struct Config
+    {
+        int connections = 6;  // per host
+        int pipelining = 1;   // requests outstanding per connection, 1 = plain keep-alive
+        bool compress = true; // send Accept-Encoding: gzip, deflate
+    };
+
+    struct Response
+    {
+        int status = 0;
+        QByteArray body;                       // decoded
+        qint64 wireBytes = 0;                  // body bytes as received, before decoding
+        QHash<QByteArray, QByteArray> headers; // names lower-cased
+        QString error;                         // set if the request failed below the HTTP level
+        qint64 connected = 0, firstByte = 0;   // Perf::nowNs() timestamps; connected is 0 on a reused connection
+        // first response on a new connection only:
+        qint64 setupNs = 0;                    // connection setup (DNS, TCP, TLS)
+        qint64 setupSaved = 0;                 // ... of which done before this request was made, thanks to preconnect()
+        bool ticketOffered = false;            // the TLS handshake offered a session ticket
+    };
+    typedef std::function<void(Response & r)> DoneFn;
+    typedef quint64 Id;
+
+    explicit HttpClient(const Config & c, QObject *parent = nullptr);
+    ~HttpClient() override;
+
+    const Config & config() const { return cfg; }
+    /// Queues a GET with extraHeaders (complete "Name: value\r\n" lines). done is called exactly
+    /// once, from the event loop, or from abort().
+    Id get(const QUrl & url, const QByteArray & extraHeaders, const DoneFn & done);
+    /// Fails the request with "aborted" before returning. HTTP/1.1 can't cancel a request that
+    /// has been sent, so that takes its connection down, and whatever was pipelined with it is
+    /// sent again.
+    void abort(Id id);
+    /// Opens connections to url's host until it has n (at most Config::connections), to be
+    /// ready before the requests come.
+    void preconnect(const QUrl & url, int n);
+    const QByteArray & sessionTicket() const { return ticket; }
+    void setSessionTicket(const QByteArray & t) { ticket = t; }
+    /// Response bodies are taken from p (sized from Content-Length where there is one) rather
+    /// than allocated; the caller gives them back once it's done with them.
+    void setBufferPool(BufferPool *p) { bodies = p; }
+
+private:
+    struct Request
+    {
+        Id id = 0;
+        QByteArray head; // the request as sent
+        qint64 queuedAt = 0;
+        DoneFn done;
+    };
+    struct Conn
+    {
+        QSslSocket *sock = nullptr; // null once closed
+        QByteArray host;            // pool key
+        QByteArray in;              // receive buffer
+        int pos = 0;                // parsed up to here
+        std::deque<Request> sent;   // written (or to be, once connected), oldest first
+        bool ready = false;
+        bool preconnected = false, ticketOffered = false;
+        qint64 openedAt = 0;
+        qint64 connectedAt = 0;     // reported with the first response only
+        int served = 0;
+        // the response to sent.front() being parsed
+        enum State { StatusLine, Headers, Body, ChunkSize, ChunkData, ChunkEnd, Trailers, UntilClose } state = StatusLine;
+        qint64 remaining = 0;
+        bool closeAfter = false;
+        std::unique_ptr<Inflater> inflate; // when the response has a Content-Encoding
+        Response resp;
+    };
+    typedef std::shared_ptr<Conn> ConnPtr;
+
+    QByteArray hostKey(const QUrl & url);
+    void dispatch(const QByteArray & host);
+    ConnPtr open(const QByteArray & host);
+    void send(const ConnPtr & c, Request && r);
+    void onReadyRead(const ConnPtr & c);
+    bool parse(const ConnPtr & c);
+    bool appendBody(const ConnPtr & c, const char *data, int n);
+    void complete(const ConnPtr & c);
+    void closed(const ConnPtr & c, const QString & error);
+    void teardown(const ConnPtr & c);
+    bool readLine(Conn & c, QByteArray & line);
+
+    Config cfg;
+    Id nextId = 1;
+    QHash<QByteArray, QList<ConnPtr>> pools;          // by "scheme://host:port"
+    QHash<QByteArray, std::deque<Request>> waiting;   // not yet on a connection
+    QHash<QByteArray, QUrl> origins;                  // where to connect for each pool
+    QByteArray ticket;                                // TLS session ticket offered by new connections
+    BufferPool *bodies = nullptr;
+};
+
+#endif // HTTPCLIENT_H
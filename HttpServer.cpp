@@ -0,0 +1,163 @@
+#include "HttpServer.h"
+#include <QTcpSocket>
+#include <QThread>
+#include <algorithm>
+#include <memory>
+
+QByteArray HttpRequest::queryValue(const QByteArray & name) const
+{
+    for (const QByteArray & kv : query.split('&')) {
+        const int eq = kv.indexOf('=');
+        if ((eq < 0 ? kv : kv.left(eq)) == name)
+            return eq < 0 ? QByteArray() : QByteArray::fromPercentEncoding(kv.mid(eq + 1));
+    }
+    return QByteArray();
+}
+
+HttpServer::HttpServer(QObject *parent) : QTcpServer(parent) {}
+
+HttpServer::~HttpServer()
+{
+    close();
+    for (const Worker & w : workers) {
+        w.thread->quit();
+        w.thread->wait();
+        delete w.ctx; // and with it that worker's sockets
+        delete w.thread;
+    }
+}
+
+void HttpServer::setWorkerThreads(int n)
+{
+    for (int i = int(workers.size()); i < n; ++i) {
+        Worker w;
+        w.thread = new QThread;
+        w.ctx = new QObject;
+        w.ctx->moveToThread(w.thread);
+        w.thread->start();
+        workers.append(w);
+    }
+}
+
+const char *HttpServer::reason(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 503: return "Service Unavailable";
+    default: return "Internal Server Error";
+    }
+}
+
+void HttpServer::incomingConnection(qintptr fd)
+{
+    if (workers.isEmpty()) {
+        QTcpSocket *s = new QTcpSocket(this);
+        if (!s->setSocketDescriptor(fd)) { delete s; return; }
+        serve(s);
+        return;
+    }
+    QObject *ctx = workers[nextWorker++ % workers.size()].ctx;
+    QMetaObject::invokeMethod(ctx, [this,ctx,fd]{
+        QTcpSocket *s = new QTcpSocket(ctx);
+        if (!s->setSocketDescriptor(fd)) { delete s; return; }
+        serve(s);
+    }, Qt::QueuedConnection);
+}
+
+void HttpServer::serve(QTcpSocket *s)
+{
+    s->setSocketOption(QAbstractSocket::LowDelayOption, 1); // responses are small; don't let Nagle hold them
+    std::shared_ptr<QByteArray> in = std::make_shared<QByteArray>();
+    connect(s, &QTcpSocket::readyRead, s, [this,s,in]{ onReadyRead(s, *in); });
+    connect(s, &QTcpSocket::disconnected, s, [this,s]{
+        connectionClosed(s);
+        s->deleteLater();
+    });
+}
+
+void HttpServer::onReadyRead(QTcpSocket *s, QByteArray & in)
+{
+    if (s->state() != QAbstractSocket::ConnectedState) { // closing after a rejected request
+        s->readAll();
+        return;
+    }
+    in += s->readAll();
+    int end;
+    while ((end = in.indexOf("\r\n\r\n")) >= 0) {
+        if (end > MaxHeaderBytes) {
+            reject(s, in, "request header too large");
+            return;
+        }
+        const QList<QByteArray> lines = in.left(end).split('\n');
+        in.remove(0, end + 4);
+        const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        if (requestLine.size() < 3) {
+            // whatever follows can't be trusted to start a request either
+            reject(s, in, "bad request");
+            return;
+        }
+        HttpRequest req;
+        req.method = requestLine[0];
+        const QByteArray & target = requestLine[1];
+        const int q = target.indexOf('?');
+        req.path = q < 0 ? target : target.left(q);
+        if (q >= 0) req.query = target.mid(q + 1);
+        for (int i = 1; i < lines.size(); ++i) {
+            const int colon = lines[i].indexOf(':');
+            if (colon > 0) req.headers.insert(lines[i].left(colon).trimmed().toLower(), lines[i].mid(colon + 1).trimmed());
+        }
+        if (req.method != "GET") {
+            send(s, 405, "{\"error\":\"only GET is supported\"}");
+            continue;
+        }
+        handle(s, req);
+    }
+    if (in.size() > MaxHeaderBytes) reject(s, in, "request header too large"); // and still no end in sight
+}
+
+void HttpServer::reject(QTcpSocket *s, QByteArray & in, const QByteArray & why)
+{
+    in.clear();
+    HttpResponse r;
+    r.status = 400;
+    r.body = "{\"error\":\"" + why + "\"}";
+    r.close = true;
+    send(s, r);
+}
+
+void HttpServer::send(QTcpSocket *s, const HttpResponse & r)
+{
+    QByteArray out = "HTTP/1.1 " + QByteArray::number(r.status) + " " + reason(r.status) + "\r\n"
+                     "Content-Type: " + r.contentType + "\r\n"
+                     "Connection: " + (r.close ? "close" : "keep-alive") + "\r\n";
+    out += r.extraHeaders;
+    if (chunkSize > 0 && r.status != 304) {
+        out += "Transfer-Encoding: chunked\r\n\r\n";
+        for (int i = 0; i < r.body.size(); i += chunkSize) {
+            const int n = std::min(chunkSize, r.body.size() - i);
+            out += QByteArray::number(n, 16) + "\r\n";
+            out += r.body.mid(i, n);
+            out += "\r\n";
+        }
+        out += "0\r\n\r\n";
+    } else {
+        out += "Content-Length: " + QByteArray::number(r.body.size()) + "\r\n\r\n";
+        out += r.body;
+    }
+    if (r.close) {
+        // straight to the socket, ahead of anything write() holds back: the connection is done with
+        s->write(out);
+        s->disconnectFromHost(); // after the pending bytes have gone
+        return;
+    }
+    write(s, out);
+}
+
+void HttpServer::write(QTcpSocket *s, const QByteArray & bytes)
+{
+    s->write(bytes);
+}
@@ -0,0 +1,65 @@
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <QTcpServer>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+
+class QTcpSocket;
+class QThread;
+
+struct HttpRequest
+{
+    QByteArray method, path, query;      // target split at '?'
+    QHash<QByteArray, QByteArray> headers; // names lower-cased
+    QByteArray queryValue(const QByteArray & name) const;
+};
+
+struct HttpResponse
+{
+    int status = 200;
+    QByteArray body;
+    QByteArray contentType = "application/json";
+    QByteArray extraHeaders; // complete "Name: value\r\n" lines
+    bool close = false;      // close the connection once this is sent
+};
+
+/// Minimal HTTP/1.1 server: GET requests with keep-alive and pipelining, nothing else. A
+/// request whose head is malformed or longer than MaxHeaderBytes gets a 400 and the
+/// connection is closed.
+///
+/// With setWorkerThreads(n), accepted connections are spread round-robin over n threads with
+/// their own event loops, and handle() runs on those threads concurrently; otherwise everything
+/// happens on the server's thread.
+class HttpServer : public QTcpServer
+{
+public:
+    explicit HttpServer(QObject *parent = nullptr);
+    ~HttpServer() override;
+
+    void setWorkerThreads(int n); // call before listen()
+
+protected:
+    virtual void handle(QTcpSocket *s, const HttpRequest & req) = 0;
+    virtual void write(QTcpSocket *s, const QByteArray & bytes);
+    virtual void connectionClosed(QTcpSocket *) {}
+    void send(QTcpSocket *s, const HttpResponse & r);
+    void send(QTcpSocket *s, int status, const QByteArray & body) { HttpResponse r; r.status = status; r.body = body; send(s, r); }
+    static const char *reason(int status);
+
+    void incomingConnection(qintptr fd) override;
+    enum { MaxHeaderBytes = 16*1024 }; // request line and headers
+    int chunkSize = 0; // > 0: bodies are sent with Transfer-Encoding: chunked in chunks of this size
+
+private:
+    void serve(QTcpSocket *s);
+    void onReadyRead(QTcpSocket *s, QByteArray & in);
+    void reject(QTcpSocket *s, QByteArray & in, const QByteArray & why);
+
+    struct Worker { QThread *thread; QObject *ctx; };
+    QList<Worker> workers;
+    int nextWorker = 0;
+};
+
+#endif // HTTPSERVER_H
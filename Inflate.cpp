@@ -0,0 +1,83 @@
+#include "Inflate.h"
+#include <zlib.h>
+#include <algorithm>
+
+namespace {
+    const int MinRoom = 16*1024;
+}
+
+Inflater::Inflater() {}
+
+Inflater::~Inflater()
+{
+    if (zs) {
+        inflateEnd(zs);
+        delete zs;
+    }
+}
+
+bool Inflater::supports(const QByteArray & encoding)
+{
+    const QByteArray e = encoding.trimmed().toLower();
+    return e == "gzip" || e == "x-gzip" || e == "deflate";
+}
+
+bool Inflater::begin(const QByteArray & encoding)
+{
+    if (!supports(encoding)) return false;
+    started = true;
+    return true;
+}
+
+bool Inflater::feed(const char *data, int n, QByteArray & out)
+{
+    if (done || n <= 0) return true; // anything after the end of the stream is ignored
+    QByteArray first;
+    if (!zs) {
+        if (head.isEmpty() && n < 2) {
+            head = QByteArray(data, n);
+            return true;
+        }
+        if (!head.isEmpty()) {
+            first = head + QByteArray(data, n);
+            data = first.constData();
+            n = first.size();
+        }
+        // gzip magic, or a zlib header (deflate method, check bits); anything else is raw deflate
+        const uchar b0 = uchar(data[0]), b1 = uchar(data[1]);
+        const bool wrapped = (b0 == 0x1f && b1 == 0x8b) || ((b0 & 0x0f) == 8 && ((b0 << 8) | b1) % 31 == 0);
+        zs = new z_stream;
+        zs->zalloc = Z_NULL;
+        zs->zfree = Z_NULL;
+        zs->opaque = Z_NULL;
+        zs->next_in = Z_NULL;
+        zs->avail_in = 0;
+        if (inflateInit2(zs, wrapped ? 15 + 32 : -15) != Z_OK) { // 15 + 32: zlib or gzip, detected
+            delete zs;
+            zs = nullptr;
+            err = "could not initialise zlib";
+            return false;
+        }
+    }
+    zs->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    zs->avail_in = uInt(n);
+    do {
+        // JSON pages compress about 4-8x; leave room for that and let QByteArray amortise the rest
+        const int at = out.size(), room = std::max(MinRoom, 4*n);
+        out.resize(at + room);
+        zs->next_out = reinterpret_cast<Bytef *>(out.data() + at);
+        zs->avail_out = uInt(room);
+        const int r = inflate(zs, Z_NO_FLUSH);
+        out.resize(at + room - int(zs->avail_out)); // shrinking keeps the capacity
+        if (r == Z_STREAM_END) {
+            done = true;
+            break;
+        }
+        if (r == Z_BUF_ERROR) break; // no progress possible until more input arrives
+        if (r != Z_OK) {
+            err = zs->msg ? QString::fromLatin1(zs->msg) : QString("corrupt compressed data");
+            return false;
+        }
+    } while (zs->avail_in > 0 || zs->avail_out == 0);
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <QByteArray>
+#include <QString>
+
+struct z_stream_s;
+
+/// Streaming decoder for gzip and deflate Content-Encodings (zlib). Compressed body bytes are
+/// fed in as they arrive and the decoded bytes appended to the page, so decompression overlaps
+/// the transfer instead of waiting for the whole body.
+///
+/// "deflate" is meant to be zlib-wrapped, but some servers send raw deflate; the first two bytes
+/// tell which.
+class Inflater
+{
+public:
+    Inflater();
+    ~Inflater();
+
+    /// True for the Content-Encoding values begin() accepts.
+    static bool supports(const QByteArray & encoding);
+    /// Starts decoding a body with this Content-Encoding. Returns false if it isn't supported.
+    bool begin(const QByteArray & encoding);
+    bool active() const { return started; }
+    /// Decodes n more bytes, appending the output to out. Returns false, with error() set, if
+    /// the data is corrupt.
+    bool feed(const char *data, int n, QByteArray & out);
+    /// True once the end of the compressed stream has been seen.
+    bool finished() const { return done; }
+    const QString & error() const { return err; }
+
+private:
+    Q_DISABLE_COPY(Inflater)
+    z_stream_s *zs = nullptr; // set up by the first feed()
+    QByteArray head;          // the first byte, when it arrived on its own
+    bool started = false, done = false;
+    QString err;
+};
+
+#endif // INFLATE_H
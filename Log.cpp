@@ -0,0 +1,3 @@
+#include "Log.h"
+
+/*static*/ QMutex Log::mut;
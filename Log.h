@@ -0,0 +1,51 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <QTextStream>
+#include <QString>
+#include <QMutex>
+#include <QMutexLocker>
+#include <iostream>
+#include <cstdlib>
+#include <utility>
+
+class Log : public QTextStream
+{
+public:
+    Log() { setString(&str, QIODevice::WriteOnly); }
+    template <typename ...T>
+    Log(const char *fmt,T&&...args) {
+        setString(&str, QIODevice::WriteOnly);
+        QString s = QString().sprintf(fmt,std::forward<T>(args)...);
+        (*this) << s;
+    }
+    virtual ~Log() { finishPrt(); }
+protected:
+    void finishPrt() {
+        flush();
+        setString(0);
+        if (str.isNull()) return;
+        QMutexLocker l(&mut);
+        if (str.isEmpty() || !str.endsWith("\n")) str += "\n";
+        std::cout << str.toUtf8().constData();
+        str = QString::null;
+    }
+
+private:
+    static QMutex mut;
+    QString str;
+};
+
+class Fatal : public Log
+{
+public:
+    Fatal() {}
+    template <typename ... T>
+    Fatal(const char *fmt, T&&...args) : Log(fmt, std::forward<T>(args)...) {}
+    ~Fatal() {
+        finishPrt();
+        std::exit(1); // exit immediately
+    }
+};
+
+#endif // LOG_H
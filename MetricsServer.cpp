@@ -0,0 +1,19 @@
+#include "MetricsServer.h"
+#include "Perf.h"
+
+MetricsServer::MetricsServer(QObject *parent) : HttpServer(parent)
+{
+    setWorkerThreads(1);
+}
+
+void MetricsServer::handle(QTcpSocket *s, const HttpRequest & req)
+{
+    if (req.path != "/metrics") {
+        send(s, 404, "{\"error\":\"not found\"}");
+        return;
+    }
+    HttpResponse r;
+    r.contentType = "text/plain; version=0.0.4";
+    r.body = Perf::prometheusText();
+    send(s, r);
+}
@@ -0,0 +1,20 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include "HttpServer.h"
+#include <QHostAddress>
+
+/// Serves Perf's counters, gauges and phase histograms as Prometheus text on /metrics
+/// (--metrics-port). Scrapes are answered on a thread of their own, so they neither wait
+/// for nor hold up the download pipeline.
+class MetricsServer : public HttpServer
+{
+public:
+    explicit MetricsServer(QObject *parent = nullptr);
+    bool start(const QHostAddress & address, quint16 port) { return listen(address, port); }
+
+protected:
+    void handle(QTcpSocket *s, const HttpRequest & req) override;
+};
+
+#endif // METRICSSERVER_H
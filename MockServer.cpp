@@ -0,0 +1,218 @@
+#include "MockServer.h"
+#include <QTcpSocket>
+#include <QTimer>
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include <QList>
+#include <algorithm>
+
+namespace {
+    const qint64 DaySecs = 24ll*60ll*60ll;
+
+    quint64 splitmix64(quint64 x)
+    {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+}
+
+MockServer::MockServer(const Config & c, QObject *parent)
+    : HttpServer(parent), cfg(c), rng(c.seed)
+{
+    chunkSize = cfg.chunkSize;
+}
+
+bool MockServer::start()
+{
+    if (!cfg.tipTime) cfg.tipTime = QDateTime::currentMSecsSinceEpoch() / 1000ll;
+    if (cfg.blockSpacing < 2) cfg.blockSpacing = 2;
+    startedAt = QDateTime::currentMSecsSinceEpoch() / 1000ll;
+    return listen(QHostAddress::LocalHost, cfg.port);
+}
+
+QString MockServer::baseUrl() const
+{
+    return QString("http://127.0.0.1:%1").arg(serverPort());
+}
+
+double MockServer::nextRandom()
+{
+    rng = splitmix64(rng);
+    return double(rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+qint64 MockServer::tipTime() const
+{
+    return cfg.live ? cfg.tipTime + (QDateTime::currentMSecsSinceEpoch() / 1000ll - startedAt) : cfg.tipTime;
+}
+
+qint64 MockServer::tipHeight() const
+{
+    // block times are increasing, so step back from the nominal height until one is in the past
+    const qint64 tip = tipTime();
+    qint64 h = (tip - cfg.genesisTime) / cfg.blockSpacing + 1;
+    while (h > 0 && blockTime(h) > tip) --h;
+    return h;
+}
+
+qint64 MockServer::blockTime(qint64 height) const
+{
+    const qint64 sp = cfg.blockSpacing;
+    const qint64 jitter = qint64(splitmix64(quint64(height) ^ cfg.seed) % quint64(sp)) - sp/2;
+    return cfg.genesisTime + height*sp + jitter;
+}
+
+QByteArray MockServer::blockHash(qint64 height) const
+{
+    QByteArray h("0000000000000000");
+    quint64 x = quint64(height) ^ (cfg.seed << 32);
+    for (int i = 0; i < 3; ++i)
+        h += QByteArray::number(x = splitmix64(x), 16).rightJustified(16, '0');
+    return h;
+}
+
+QByteArray MockServer::blocksPage(qint64 ms) const
+{
+    const qint64 day = ms >= 0 ? ms / 86400000ll : (ms - 86399999ll) / 86400000ll;
+    const qint64 from = day*DaySecs, to = from + DaySecs, sp = cfg.blockSpacing;
+    const qint64 hlo = std::max(qint64(0), (from - cfg.genesisTime)/sp - 1);
+    const qint64 tip = tipTime();
+    const qint64 hhi = (std::min(to, tip + 1) - cfg.genesisTime)/sp + 1;
+    QByteArray out("{\"blocks\":[");
+    out.reserve(int(std::max(qint64(0), hhi - hlo + 1)) * 128 + 16);
+    for (qint64 h = hhi; h >= hlo; --h) {
+        const qint64 t = blockTime(h);
+        if (t < from || t >= to || t > tip) continue;
+        if (cfg.gapRate > 0. && double(splitmix64(quint64(h) ^ ~cfg.seed) >> 11) * (1.0 / 9007199254740992.0) < cfg.gapRate)
+            continue;
+        appendBlock(out, h, t, blockHash(h));
+    }
+    out += "]}";
+    return out;
+}
+
+QByteArray MockServer::heightPage(qint64 height) const
+{
+    QByteArray out("{\"blocks\":[");
+    appendBlock(out, height, blockTime(height), blockHash(height));
+    out += "]}";
+    return out;
+}
+
+QByteArray MockServer::latestBlock() const
+{
+    const qint64 h = tipHeight();
+    return "{\"hash\":\"" + blockHash(h) + "\",\"time\":" + QByteArray::number(blockTime(h))
+           + ",\"block_index\":" + QByteArray::number(h) + ",\"height\":" + QByteArray::number(h) + "}";
+}
+
+void MockServer::appendBlock(QByteArray & out, qint64 height, qint64 time, const QByteArray & hash)
+{
+    out += out.endsWith('[') ? "{\"hash\":\"" : ",{\"hash\":\"";
+    out += hash;
+    out += "\",\"height\":";
+    out += QByteArray::number(height);
+    out += ",\"time\":";
+    out += QByteArray::number(time);
+    out += ",\"main_chain\":true}";
+}
+
+void MockServer::handle(QTcpSocket *s, const HttpRequest & req)
+{
+    if (cfg.latencyMs > 0)
+        QTimer::singleShot(cfg.latencyMs, s, [this,s,req]{ respond(s, req); });
+    else
+        respond(s, req);
+}
+
+void MockServer::respond(QTcpSocket *s, const HttpRequest & req)
+{
+    ++nServed;
+    const double r = nextRandom();
+    if (r < cfg.dropRate) {
+        s->abort();
+        return;
+    }
+    if (r < cfg.dropRate + cfg.errorRate) {
+        send(s, 500, "{\"error\":\"injected failure\"}");
+        return;
+    }
+    const QByteArray & path = req.path;
+    bool ok;
+    if (path == "/latestblock") {
+        HttpResponse r;
+        const QByteArray etag = "\"" + QByteArray::number(tipHeight()) + "\"";
+        r.extraHeaders = "ETag: " + etag + "\r\n";
+        if (req.headers.value("if-none-match") == etag) r.status = 304;
+        else r.body = latestBlock();
+        send(s, r);
+        return;
+    }
+    if (path.startsWith("/block-height/")) {
+        const qint64 h = path.mid(14).toLongLong(&ok);
+        if (!ok) send(s, 400, "{\"error\":\"bad height\"}");
+        else if (h < 0 || blockTime(h) > tipTime()) send(s, 404, "{\"error\":\"no such block\"}");
+        else sendPage(s, req, heightPage(h));
+        return;
+    }
+    if (!path.startsWith("/blocks/")) {
+        send(s, 404, "{\"error\":\"not found\"}");
+        return;
+    }
+    const qint64 ms = path.mid(8).toLongLong(&ok);
+    if (!ok) {
+        send(s, 400, "{\"error\":\"bad timestamp\"}");
+        return;
+    }
+    if (!cfg.recordDir.isEmpty()) {
+        QFile f(QDir(cfg.recordDir).filePath(QString("%1.json").arg(ms / 86400000ll)));
+        if (f.open(QIODevice::ReadOnly)) {
+            sendPage(s, req, f.readAll());
+            return;
+        }
+    }
+    sendPage(s, req, blocksPage(ms));
+}
+
+void MockServer::sendPage(QTcpSocket *s, const HttpRequest & req, const QByteArray & body)
+{
+    HttpResponse r;
+    if (cfg.compress && req.headers.value("accept-encoding").contains("deflate")) {
+        r.body = qCompress(body).mid(4); // drop Qt's length prefix, leaving the zlib stream HTTP calls deflate
+        r.extraHeaders = "Content-Encoding: deflate\r\n";
+    } else {
+        r.body = body;
+    }
+    send(s, r);
+}
+
+void MockServer::write(QTcpSocket *s, const QByteArray & bytes)
+{
+    if (cfg.bytesPerSec <= 0) {
+        s->write(bytes);
+        return;
+    }
+    QByteArray & out = outBufs[s];
+    const bool idle = out.isEmpty();
+    out += bytes;
+    if (idle) pump(s);
+}
+
+void MockServer::connectionClosed(QTcpSocket *s)
+{
+    outBufs.remove(s);
+}
+
+void MockServer::pump(QTcpSocket *s)
+{
+    auto it = outBufs.find(s);
+    if (it == outBufs.end() || it->isEmpty()) return;
+    const int slice = int(std::max(qint64(1), cfg.bytesPerSec / 100)); // 10 ms worth
+    s->write(it->constData(), std::min(slice, it->size()));
+    it->remove(0, slice);
+    if (!it->isEmpty())
+        QTimer::singleShot(10, s, [this,s]{ pump(s); });
+}
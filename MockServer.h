@@ -0,0 +1,77 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include "HttpServer.h"
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+
+class QTcpSocket;
+
+/// Local stand-in for blockchain.info, for hermetic and reproducible benchmark runs.
+///
+/// Serves /blocks/<ms>?format=json pages, either recorded ones (<recordDir>/<utc day>.json,
+/// as written by BlockChainGrok --record) or pages cut from a deterministic synthetic chain,
+/// /block-height/<h>?format=json for single blocks of the synthetic chain, and /latestblock
+/// (with an ETag, answering 304 to a matching If-None-Match). With `live` the synthetic tip
+/// advances with the wall clock, for --watch runs.
+/// Page bodies are deflate-compressed for clients that accept it.
+/// Latency, bandwidth, chunked transfer and error injection are configurable; all randomness
+/// comes from the seed, so the same config and request sequence always gives the same responses.
+class MockServer : public HttpServer
+{
+public:
+    struct Config
+    {
+        quint16 port = 0;                 // 0 = any free port
+        int latencyMs = 0;                // delay before each response
+        qint64 bytesPerSec = 0;           // response bandwidth cap per connection, 0 = unlimited
+        int chunkSize = 0;                // > 0: bodies use Transfer-Encoding: chunked with chunks of this size
+        double errorRate = 0.;            // fraction of requests answered with HTTP 500
+        double dropRate = 0.;             // fraction of requests whose connection is closed without a response
+        quint64 seed = 1;
+        QString recordDir;                // recorded pages, served in preference to synthetic ones
+        qint64 genesisTime = 1231006505;  // synthetic chain: time of block 0
+        qint64 tipTime = 0;               // synthetic chain: no blocks after this time; 0 = time of startup
+        int blockSpacing = 600;           // synthetic chain: mean block interval in seconds
+        double gapRate = 0.;              // synthetic chain: fraction of blocks left out of /blocks pages
+        bool live = false;                // synthetic chain: the tip moves forward from tipTime in real time
+        bool compress = true;             // answer Accept-Encoding: deflate with compressed pages
+    };
+
+    explicit MockServer(const Config & c, QObject *parent = nullptr);
+
+    bool start(); // listen on 127.0.0.1:port
+    QString baseUrl() const;
+    const Config & config() const { return cfg; }
+    quint64 requestsServed() const { return nServed; }
+
+    qint64 tipTime() const; // synthetic chain: no blocks after this time
+    qint64 tipHeight() const;
+    /// Synthetic chain: strictly increasing block times, spacing +/- spacing/2 apart.
+    qint64 blockTime(qint64 height) const;
+    QByteArray blockHash(qint64 height) const;
+    /// Body for /blocks/<ms>: the blocks whose time falls in the UTC day containing ms, newest first.
+    QByteArray blocksPage(qint64 ms) const;
+    /// Body for /block-height/<h>; callers check that the block exists (404 otherwise).
+    QByteArray heightPage(qint64 height) const;
+    QByteArray latestBlock() const;
+
+private:
+    void handle(QTcpSocket *s, const HttpRequest & req) override;
+    void write(QTcpSocket *s, const QByteArray & bytes) override;
+    void connectionClosed(QTcpSocket *s) override;
+    void respond(QTcpSocket *s, const HttpRequest & req);
+    void sendPage(QTcpSocket *s, const HttpRequest & req, const QByteArray & body);
+    void pump(QTcpSocket *s);
+    double nextRandom();
+    static void appendBlock(QByteArray & out, qint64 height, qint64 time, const QByteArray & hash);
+
+    Config cfg;
+    quint64 rng;
+    quint64 nServed = 0;
+    qint64 startedAt = 0; // wall clock seconds at start(), for live mode
+    QHash<QTcpSocket *, QByteArray> outBufs;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,125 @@
+#include "Notifier.h"
+#include "Log.h"
+#include "Perf.h"
+#include <QLocalSocket>
+
+bool Notifier::listen(const QString & name)
+{
+    QObject::connect(&server, &QLocalServer::newConnection, &server, [this]{ accept(); });
+    if (server.listen(name)) return true;
+    if (server.serverError() != QAbstractSocket::AddressInUseError) return false;
+    // a socket file left behind by a run that didn't exit cleanly, or another instance's live one
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(1000)) return false; // live: leave it alone
+    QLocalServer::removeServer(name);
+    return server.listen(name);
+}
+
+bool Notifier::hasSubscribers(Topic t) const
+{
+    return topicCounts[t] > 0;
+}
+
+void Notifier::accept()
+{
+    while (QLocalSocket *s = server.nextPendingConnection()) {
+        subs.insert(s, Subscriber());
+        QObject::connect(s, &QLocalSocket::readyRead, s, [this,s]{ onReadyRead(s); });
+        QObject::connect(s, &QLocalSocket::bytesWritten, s, [this,s]{ flush(s); });
+        QObject::connect(s, &QLocalSocket::disconnected, s, [this,s]{ drop(s, nullptr); });
+    }
+}
+
+void Notifier::onReadyRead(QLocalSocket *s)
+{
+    auto it = subs.find(s);
+    if (it == subs.end()) return;
+    it->in += s->readAll();
+    int nl;
+    while ((nl = it->in.indexOf('\n')) >= 0) {
+        const QByteArray topic = it->in.left(nl).trimmed();
+        it->in.remove(0, nl + 1);
+        const int t = topic == "blocks" ? Blocks : topic == "stats" ? Stats : 0;
+        if (!t) {
+            it->reply = "{\"type\":\"error\",\"error\":\"unknown topic\"}\n";
+            flush(s);
+        } else if (!(it->topics & t)) {
+            it->topics |= t;
+            ++topicCounts[t];
+        }
+    }
+    if (it->in.size() > 1024) drop(s, "sent an overlong line"); // nobody legitimate does
+}
+
+void Notifier::publishBlock(const Block & b)
+{
+    if (!topicCounts[Blocks]) return;
+    const QByteArray ev = "{\"type\":\"block\",\"height\":" + QByteArray::number(b.height) + ",\"time\":"
+                          + QByteArray::number(b.time) + ",\"hash\":\"" + b.hash.toLatin1() + "\"}\n";
+    QList<QLocalSocket *> overflowed;
+    for (auto it = subs.begin(); it != subs.end(); ++it) {
+        if (!(it->topics & Blocks)) continue;
+        if (it->blocks.size() >= MaxQueuedBlocks) {
+            overflowed.append(it.key());
+            continue;
+        }
+        it->blocks.push_back(ev); // implicitly shared, so one copy of the event however many subscribers
+        flush(it.key());
+    }
+    for (QLocalSocket *s : overflowed)
+        drop(s, "fell too far behind");
+}
+
+void Notifier::publishStats(const IntervalStats & s, qint64 median, qint64 p99)
+{
+    if (!topicCounts[Stats]) return;
+    const QByteArray ev = "{\"type\":\"stats\",\"blocks\":" + QByteArray::number(s.nBlocks)
+                          + ",\"avg_secs\":" + QByteArray::number(s.avg, 'f', 3)
+                          + ",\"median_secs\":" + QByteArray::number(median)
+                          + ",\"p99_secs\":" + QByteArray::number(p99)
+                          + ",\"cutoff_avg_secs\":" + QByteArray::number(s.nCutoff ? double(s.cutoffDeltaSums)/double(s.nCutoff) : 0., 'f', 3)
+                          + "}\n";
+    for (auto it = subs.begin(); it != subs.end(); ++it) {
+        if (!(it->topics & Stats)) continue;
+        if (!it->stats.isEmpty()) Perf::count(Perf::NotifyCoalesced);
+        it->stats = ev;
+        flush(it.key());
+    }
+}
+
+// Writes queued events while the socket's own buffer is below HighWater; the rest waits for bytesWritten.
+void Notifier::flush(QLocalSocket *s)
+{
+    auto it = subs.find(s);
+    if (it == subs.end()) return;
+    while (s->bytesToWrite() < HighWater) {
+        if (!it->reply.isEmpty()) {
+            s->write(it->reply);
+            it->reply.clear();
+        } else if (!it->blocks.empty()) {
+            s->write(it->blocks.front());
+            it->blocks.pop_front();
+        } else if (!it->stats.isEmpty()) {
+            s->write(it->stats); // after the blocks it reflects
+            it->stats.clear();
+        } else {
+            break;
+        }
+    }
+}
+
+void Notifier::drop(QLocalSocket *s, const char *why)
+{
+    auto it = subs.find(s);
+    if (it == subs.end()) return;
+    for (int t : {int(Blocks), int(Stats)})
+        if (it->topics & t) --topicCounts[t];
+    subs.erase(it);
+    if (why) {
+        Perf::count(Perf::SubscribersDropped);
+        Log("Dropping subscriber: %s", why);
+        s->abort();
+    }
+    s->deleteLater();
+}
@@ -0,0 +1,59 @@
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+#include <QLocalServer>
+#include <QByteArray>
+#include <QHash>
+#include <deque>
+#include "Block.h"
+#include "Stats.h"
+
+class QLocalSocket;
+
+/// Push notifications for local subscribers (--notify-socket). A subscriber connects to the
+/// Unix domain socket and sends "blocks", "stats" or both, one per line, then receives one
+/// JSON object per line:
+///
+///     {"type":"block","height":h,"time":t,"hash":"..."}
+///     {"type":"stats","blocks":n,"avg_secs":a,"median_secs":m,"p99_secs":p,"cutoff_avg_secs":c}
+///
+/// Publishing only appends to per-subscriber queues, which drain as each socket accepts data,
+/// so ingestion never waits on a consumer. A subscriber that falls behind has its pending stats
+/// event replaced by the newest one, and is disconnected once MaxQueuedBlocks block events
+/// pile up. A line naming no known topic is answered with an error object, queued the same
+/// way, with repeats coalesced.
+class Notifier
+{
+public:
+    enum Topic { Blocks = 1, Stats = 2 };
+
+    /// Replaces a stale socket file of the same name, but fails if another process is listening on it.
+    bool listen(const QString & name);
+    QString errorString() const { return server.errorString(); }
+    bool hasSubscribers(Topic t) const;
+
+    void publishBlock(const Block & b);
+    void publishStats(const IntervalStats & s, qint64 median, qint64 p99);
+
+private:
+    enum { MaxQueuedBlocks = 4096, HighWater = 64 * 1024 };
+    struct Subscriber
+    {
+        int topics = 0;
+        QByteArray in;
+        std::deque<QByteArray> blocks;
+        QByteArray stats; // newest stats event not yet written, empty if none
+        QByteArray reply; // error for the newest bad request not yet answered, empty if none
+    };
+
+    void accept();
+    void onReadyRead(QLocalSocket *s);
+    void flush(QLocalSocket *s);
+    void drop(QLocalSocket *s, const char *why);
+
+    QLocalServer server;
+    QHash<QLocalSocket *, Subscriber> subs;
+    int topicCounts[3] = {}; // subscribers per topic, indexed by Topic
+};
+
+#endif // NOTIFIER_H
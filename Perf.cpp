@@ -0,0 +1,423 @@
+#include "Perf.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QFile>
+#include <QJsonArray>
+#include <QVector>
+#include <QPair>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <cstring>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+namespace Perf
+{
+    /// Histogram with relaxed atomic fields, for the shared per-phase histograms: add() never
+    /// waits, and a snapshot taken meanwhile may be a sample or so out of step between fields,
+    /// which is fine for monitoring.
+    class AtomicHistogram
+    {
+    public:
+        AtomicHistogram() { reset(); }
+        void reset();
+        void add(qint64 ns);
+        Histogram snapshot() const;
+    private:
+        std::atomic<quint64> buckets[Histogram::NBuckets];
+        std::atomic<quint64> n;
+        std::atomic<qint64> sum, lo, hi;
+    };
+
+    void AtomicHistogram::reset()
+    {
+        for (auto & b : buckets) b.store(0, std::memory_order_relaxed);
+        n.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        lo.store(std::numeric_limits<qint64>::max(), std::memory_order_relaxed);
+        hi.store(0, std::memory_order_relaxed);
+    }
+
+    void AtomicHistogram::add(qint64 ns)
+    {
+        if (ns < 0) ns = 0;
+        buckets[Histogram::bucketOf(quint64(ns))].fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(ns, std::memory_order_relaxed);
+        n.fetch_add(1, std::memory_order_relaxed);
+        // new extremes are rare once a phase has a few samples, so these loops almost never spin
+        qint64 cur = lo.load(std::memory_order_relaxed);
+        while (ns < cur && !lo.compare_exchange_weak(cur, ns, std::memory_order_relaxed)) {}
+        cur = hi.load(std::memory_order_relaxed);
+        while (ns > cur && !hi.compare_exchange_weak(cur, ns, std::memory_order_relaxed)) {}
+    }
+
+    Histogram AtomicHistogram::snapshot() const
+    {
+        Histogram h;
+        for (int b = 0; b < Histogram::NBuckets; ++b) h.buckets[b] = buckets[b].load(std::memory_order_relaxed);
+        h.n = n.load(std::memory_order_relaxed);
+        h.sum = sum.load(std::memory_order_relaxed);
+        h.lo = h.n ? lo.load(std::memory_order_relaxed) : 0;
+        h.hi = hi.load(std::memory_order_relaxed);
+        return h;
+    }
+
+    namespace {
+        struct State
+        {
+            State() {
+                for (auto & c : counters) c.store(0, std::memory_order_relaxed);
+                for (auto & g : gauges) g.store(0, std::memory_order_relaxed);
+                bytes.store(0, std::memory_order_relaxed);
+                wireBytes.store(0, std::memory_order_relaxed);
+            }
+            AtomicHistogram hist[NPhases];
+            std::atomic<qint64> counters[NCounters];
+            std::atomic<qint64> gauges[NGauges];
+            std::atomic<qint64> bytes, wireBytes;
+            QMutex mut; // guards series
+            QVector<QPair<qint64, double>> series[NSeries]; // (nowNs, value)
+        };
+        State & state() { static State s; return s; }
+        double ms(qint64 ns) { return double(ns) / 1e6; }
+    }
+
+    const char *phaseName(int phase)
+    {
+        static const char * const names[NPhases] = {
+            "connect", "first_byte", "transfer", "request", "parse", "ingest", "stats", "csv", "checkpoint", "update", "query"
+        };
+        return phase >= 0 && phase < NPhases ? names[phase] : "unknown";
+    }
+
+    qint64 nowNs()
+    {
+        static QElapsedTimer t;
+        static const bool started = (t.start(), true);
+        Q_UNUSED(started);
+        return t.nsecsElapsed();
+    }
+
+    qint64 cpuTimeNs()
+    {
+#ifdef Q_OS_UNIX
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0)
+            return (qint64(ru.ru_utime.tv_sec) + qint64(ru.ru_stime.tv_sec)) * 1000000000ll
+                   + (qint64(ru.ru_utime.tv_usec) + qint64(ru.ru_stime.tv_usec)) * 1000ll;
+#endif
+        return 0;
+    }
+
+    qint64 threadCpuTimeNs()
+    {
+#ifdef Q_OS_UNIX
+        struct timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+            return qint64(ts.tv_sec) * 1000000000ll + qint64(ts.tv_nsec);
+#endif
+        return 0;
+    }
+
+    qint64 peakRssBytes()
+    {
+#ifdef Q_OS_UNIX
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#ifdef Q_OS_MACOS
+            return qint64(ru.ru_maxrss); // bytes on macOS
+#else
+            return qint64(ru.ru_maxrss) * 1024ll; // KiB elsewhere
+#endif
+        }
+#endif
+        return 0;
+    }
+
+    void Histogram::reset()
+    {
+        std::memset(buckets, 0, sizeof(buckets));
+        n = 0;
+        sum = lo = hi = 0;
+    }
+
+    int Histogram::bucketOf(quint64 v)
+    {
+        if (v < (1u << SubBits)) return int(v);
+        const int msb = 63 - int(qCountLeadingZeroBits(v));
+        const int sub = int((v >> (msb - SubBits)) & ((1u << SubBits) - 1));
+        return ((msb - SubBits + 1) << SubBits) + sub;
+    }
+
+    quint64 Histogram::bucketUpper(int b)
+    {
+        if (b < (1 << SubBits)) return quint64(b);
+        const int msb = (b >> SubBits) + SubBits - 1, sub = b & ((1 << SubBits) - 1);
+        const quint64 lower = quint64((1 << SubBits) + sub) << (msb - SubBits);
+        return lower + (quint64(1) << (msb - SubBits)) - 1;
+    }
+
+    void Histogram::add(qint64 ns)
+    {
+        if (ns < 0) ns = 0;
+        ++buckets[bucketOf(quint64(ns))];
+        if (!n || ns < lo) lo = ns;
+        if (ns > hi) hi = ns;
+        sum += ns;
+        ++n;
+    }
+
+    qint64 Histogram::percentile(double p) const
+    {
+        if (!n) return 0;
+        const quint64 target = std::max(quint64(1), quint64(std::ceil(p * double(n))));
+        quint64 acc = 0;
+        for (int b = 0; b < NBuckets; ++b) {
+            acc += buckets[b];
+            if (acc >= target) return std::min(qint64(bucketUpper(b)), hi);
+        }
+        return hi;
+    }
+
+    quint64 Histogram::countBelow(quint64 bound) const
+    {
+        quint64 acc = 0;
+        for (int b = 0; b < NBuckets && bucketUpper(b) < bound; ++b)
+            acc += buckets[b];
+        return acc;
+    }
+
+    void record(Phase phase, qint64 ns)
+    {
+        state().hist[phase].add(ns);
+    }
+
+    Histogram histogram(Phase phase)
+    {
+        return state().hist[phase].snapshot();
+    }
+
+    const char *counterName(int counter)
+    {
+        static const char * const names[NCounters] = {
+            "retries", "timeouts", "hedges", "hedge_wins", "polls", "polls_not_modified", "blocks_ingested", "dupe_heights", "dupe_times",
+            "notify_coalesced", "subscribers_dropped", "buffers_reused"
+        };
+        return counter >= 0 && counter < NCounters ? names[counter] : "unknown";
+    }
+
+    const char *seriesName(int series)
+    {
+        static const char * const names[NSeries] = { "concurrency" };
+        return series >= 0 && series < NSeries ? names[series] : "unknown";
+    }
+
+    const char *gaugeName(int gauge)
+    {
+        static const char * const names[NGauges] = { "requests_in_flight", "pipeline_pages" };
+        return gauge >= 0 && gauge < NGauges ? names[gauge] : "unknown";
+    }
+
+    void sample(Series series, double value)
+    {
+        const qint64 t = nowNs();
+        State & s = state();
+        QMutexLocker l(&s.mut);
+        s.series[series].append(qMakePair(t, value));
+    }
+
+    void count(Counter c, qint64 n)
+    {
+        state().counters[c].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    qint64 counter(Counter c)
+    {
+        return state().counters[c].load(std::memory_order_relaxed);
+    }
+
+    void setGauge(Gauge g, qint64 value)
+    {
+        state().gauges[g].store(value, std::memory_order_relaxed);
+    }
+
+    qint64 gauge(Gauge g)
+    {
+        return state().gauges[g].load(std::memory_order_relaxed);
+    }
+
+    void addBytes(qint64 nbytes)
+    {
+        state().bytes.fetch_add(nbytes, std::memory_order_relaxed);
+    }
+
+    void addWireBytes(qint64 nbytes)
+    {
+        state().wireBytes.fetch_add(nbytes, std::memory_order_relaxed);
+    }
+
+    QStringList summaryLines()
+    {
+        State & s = state();
+        QMutexLocker l(&s.mut);
+        QStringList ret;
+        ret << QString().sprintf("%-11s %7s %11s %9s %9s %9s %9s %9s", "phase", "count", "total_ms", "mean_ms", "p50_ms", "p90_ms", "p99_ms", "max_ms");
+        for (int i = 0; i < NPhases; ++i) {
+            const Histogram h = s.hist[i].snapshot();
+            if (!h.count()) continue;
+            ret << QString().sprintf("%-11s %7llu %11.3f %9.3f %9.3f %9.3f %9.3f %9.3f", phaseName(i), h.count(), ms(h.total()),
+                                     h.mean()/1e6, ms(h.percentile(.5)), ms(h.percentile(.9)), ms(h.percentile(.99)), ms(h.max()));
+        }
+        if (AllocTrack::enabled()) {
+            ret << QString().sprintf("%-11s %9s %9s %11s %13s", "heap", "allocs", "frees", "alloc_MiB", "peak_live_MiB");
+            for (int i = 0; i <= NPhases; ++i) {
+                const int slot = i < NPhases ? i : int(AllocTrack::Untagged);
+                const AllocTrack::Counters c = AllocTrack::counters(slot);
+                if (!c.allocs && !c.frees) continue;
+                ret << QString().sprintf("%-11s %9llu %9llu %11.3f %13.3f", i < NPhases ? phaseName(i) : "other", c.allocs, c.frees,
+                                         double(c.bytes)/1048576., double(c.peakLive)/1048576.);
+            }
+        }
+        QStringList events;
+        for (int i = 0; i < NCounters; ++i)
+            if (const qint64 c = s.counters[i].load(std::memory_order_relaxed))
+                events << QString("%1 %2").arg(counterName(i)).arg(c);
+        if (!events.isEmpty()) ret << "Events: " + events.join(", ");
+        const qint64 wall = nowNs();
+        for (int i = 0; i < NSeries; ++i) {
+            const QVector<QPair<qint64, double>> & v = s.series[i];
+            if (v.isEmpty()) continue;
+            double lo = v.first().second, hi = lo, area = 0.;
+            for (int j = 0; j < v.size(); ++j) {
+                lo = std::min(lo, v[j].second);
+                hi = std::max(hi, v[j].second);
+                area += v[j].second * double((j + 1 < v.size() ? v[j+1].first : wall) - v[j].first);
+            }
+            const qint64 span = wall - v.first().first;
+            ret << QString().sprintf("%s: min %g, max %g, time-weighted mean %.2f, final %g", seriesName(i), lo, hi,
+                                     span > 0 ? area / double(span) : v.last().second, v.last().second);
+            // at most 16 evenly spaced points, always including the last one
+            const int step = (v.size() + 15) / 16;
+            QStringList points;
+            for (int j = 0; j < v.size(); j += step)
+                points << QString().sprintf("%.2fs=%g", v[j].first/1e9, v[j].second);
+            if ((v.size() - 1) % step)
+                points << QString().sprintf("%.2fs=%g", v.last().first/1e9, v.last().second);
+            ret << "  over time: " + points.join(' ');
+        }
+        const qint64 bytes = s.bytes.load(std::memory_order_relaxed), wire = s.wireBytes.load(std::memory_order_relaxed);
+        ret << QString().sprintf("Downloaded %lld bytes in %.3f s wall time (%.1f KiB/s)", bytes, wall/1e9,
+                                 wall > 0 ? double(bytes)/1024./(wall/1e9) : 0.);
+        if (wire && wire != bytes)
+            ret << QString().sprintf("  compressed on the wire: %lld bytes (%.1fx smaller, %.1f KiB/s)", wire, double(bytes)/double(wire),
+                                     wall > 0 ? double(wire)/1024./(wall/1e9) : 0.);
+        return ret;
+    }
+
+    QByteArray toJson()
+    {
+        State & s = state();
+        QMutexLocker l(&s.mut);
+        QJsonObject phases;
+        for (int i = 0; i < NPhases; ++i) {
+            const Histogram h = s.hist[i].snapshot();
+            QJsonObject o;
+            o["count"] = double(h.count());
+            o["total_ms"] = ms(h.total());
+            o["mean_ms"] = h.mean()/1e6;
+            o["min_ms"] = ms(h.min());
+            o["p50_ms"] = ms(h.percentile(.5));
+            o["p90_ms"] = ms(h.percentile(.9));
+            o["p99_ms"] = ms(h.percentile(.99));
+            o["max_ms"] = ms(h.max());
+            phases[phaseName(i)] = o;
+        }
+        QJsonObject root;
+        root["phases"] = phases;
+        if (AllocTrack::enabled()) {
+            QJsonObject heap;
+            for (int i = 0; i <= NPhases; ++i) {
+                const AllocTrack::Counters c = AllocTrack::counters(i < NPhases ? i : int(AllocTrack::Untagged));
+                QJsonObject o;
+                o["allocs"] = double(c.allocs);
+                o["frees"] = double(c.frees);
+                o["bytes"] = double(c.bytes);
+                o["peak_live_bytes"] = double(c.peakLive);
+                heap[i < NPhases ? phaseName(i) : "other"] = o;
+            }
+            root["heap"] = heap;
+        }
+        QJsonObject counters;
+        for (int i = 0; i < NCounters; ++i)
+            counters[counterName(i)] = double(s.counters[i].load(std::memory_order_relaxed));
+        root["counters"] = counters;
+        QJsonObject series;
+        for (int i = 0; i < NSeries; ++i) {
+            QJsonArray arr;
+            for (const auto & p : s.series[i])
+                arr.append(QJsonArray{ms(p.first), p.second});
+            series[seriesName(i)] = arr;
+        }
+        root["series"] = series;
+        root["bytes"] = double(s.bytes.load(std::memory_order_relaxed));
+        root["wire_bytes"] = double(s.wireBytes.load(std::memory_order_relaxed));
+        root["wall_ms"] = ms(nowNs());
+        return QJsonDocument(root).toJson();
+    }
+
+    QByteArray prometheusText()
+    {
+        State & s = state();
+        QByteArray out;
+        out += "# HELP bcg_phase_seconds Time spent per phase (see Perf::Phase).\n"
+               "# TYPE bcg_phase_seconds histogram\n";
+        for (int i = 0; i < NPhases; ++i) {
+            const Histogram h = s.hist[i].snapshot();
+            const QByteArray label = QByteArray("{phase=\"") + phaseName(i) + "\"";
+            // power-of-two bounds line up with histogram buckets, so the counts are exact: 2^10 ns (~1 us) .. 2^36 ns (~69 s)
+            for (int k = 10; k <= 36; k += 2)
+                out += "bcg_phase_seconds_bucket" + label + ",le=\"" + QByteArray::number(double(quint64(1) << k) / 1e9, 'g', 6)
+                       + "\"} " + QByteArray::number(h.countBelow(quint64(1) << k)) + "\n";
+            out += "bcg_phase_seconds_bucket" + label + ",le=\"+Inf\"} " + QByteArray::number(h.count()) + "\n";
+            out += "bcg_phase_seconds_sum" + label + "} " + QByteArray::number(double(h.total()) / 1e9, 'g', 12) + "\n";
+            out += "bcg_phase_seconds_count" + label + "} " + QByteArray::number(h.count()) + "\n";
+        }
+        for (int i = 0; i < NCounters; ++i) {
+            const QByteArray name = QByteArray("bcg_") + counterName(i) + "_total";
+            out += "# TYPE " + name + " counter\n" + name + " " + QByteArray::number(s.counters[i].load(std::memory_order_relaxed)) + "\n";
+        }
+        out += "# TYPE bcg_downloaded_bytes_total counter\nbcg_downloaded_bytes_total "
+               + QByteArray::number(s.bytes.load(std::memory_order_relaxed)) + "\n";
+        out += "# TYPE bcg_wire_bytes_total counter\nbcg_wire_bytes_total "
+               + QByteArray::number(s.wireBytes.load(std::memory_order_relaxed)) + "\n";
+        for (int i = 0; i < NGauges; ++i) {
+            const QByteArray name = QByteArray("bcg_") + gaugeName(i);
+            out += "# TYPE " + name + " gauge\n" + name + " " + QByteArray::number(s.gauges[i].load(std::memory_order_relaxed)) + "\n";
+        }
+        {
+            QMutexLocker l(&s.mut);
+            for (int i = 0; i < NSeries; ++i) {
+                if (s.series[i].isEmpty()) continue;
+                const QByteArray name = QByteArray("bcg_") + seriesName(i);
+                out += "# TYPE " + name + " gauge\n" + name + " " + QByteArray::number(s.series[i].last().second) + "\n";
+            }
+        }
+        return out;
+    }
+
+    bool saveJson(const QString & fileName)
+    {
+        QFile f(fileName);
+        if (!f.open(QIODevice::WriteOnly|QIODevice::Truncate)) return false;
+        const QByteArray json = toJson();
+        return f.write(json) == json.size();
+    }
+}
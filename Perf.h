@@ -0,0 +1,128 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <QtGlobal>
+#include <QStringList>
+#include <QByteArray>
+#include "Trace.h"
+#include "AllocTrack.h"
+
+/// Per-phase timing on a monotonic clock. Each recorded sample goes into the
+/// phase's latency histogram, which the end-of-run summary and JSON dump read.
+/// Phase histograms, counters and gauges are lock-free (relaxed atomics), so they are
+/// cheap to update from any thread and can be scraped live (see MetricsServer).
+namespace Perf
+{
+    enum Phase {
+        Connect,    // request issued -> TLS established (DNS, TCP and TLS of new connections)
+        FirstByte,  // request sent -> response headers received
+        Transfer,   // response headers -> body complete
+        Request,    // whole request, issue -> finished
+        Parse,      // a page's bytes -> its blocks (BlockParser::parsePage)
+        Ingest,     // processResults
+        Stats,
+        Csv,        // saveCsv
+        Checkpoint, // writing or loading a checkpoint
+        Update,     // --watch: ingesting one new block and updating the running stats
+        Query,      // --serve: answering one request, snapshot lookup to response queued
+        NPhases
+    };
+    enum Counter {
+        Retries,    // attempts started after a failed one
+        Timeouts,   // attempts aborted for taking longer than the per-request timeout
+        Hedges,     // duplicate attempts started for a slow request
+        HedgeWins,  // requests answered by their hedge rather than the original attempt
+        Polls,      // --watch: /latestblock polls
+        PollsNotModified, // ... answered 304
+        BlocksIngested,   // blocks passed to BlockStore::ingest, duplicates included
+        DupeHeights,      // ... whose height was already stored
+        DupeTimes,        // ... whose timestamp another block already had
+        NotifyCoalesced,  // --notify-socket: stats events replaced by a newer one before a subscriber read them
+        SubscribersDropped, // ... subscribers disconnected for falling too far behind
+        BuffersReused,    // response body buffers recycled by BufferPool rather than allocated
+        NCounters
+    };
+    enum Gauge {
+        RequestsInFlight, // fetch attempts (hedges included) currently on the wire
+        PipelinePages,    // --threads: pages handed to the parse/ingest pipeline and not yet ingested
+        NGauges
+    };
+
+    enum Series {
+        Concurrency, // fetch concurrency limit chosen by the AIMD controller
+        NSeries
+    };
+
+    static_assert(NPhases <= AllocTrack::MaxSlots, "each phase needs an allocation slot");
+
+    const char *phaseName(int phase);
+    const char *counterName(int counter);
+    const char *seriesName(int series);
+    const char *gaugeName(int gauge);
+    qint64 nowNs(); // monotonic, relative to the first call
+    qint64 cpuTimeNs(); // user + system CPU time of the whole process
+    qint64 threadCpuTimeNs(); // CPU time of the calling thread
+    qint64 peakRssBytes(); // high-water mark of the resident set size
+
+    class AtomicHistogram;
+
+    /// Log-linear histogram (8 sub-buckets per power of two) of nanosecond samples.
+    class Histogram
+    {
+    public:
+        enum { SubBits = 3, NBuckets = 64 << SubBits };
+        Histogram() { reset(); }
+        void reset();
+        void add(qint64 ns);
+        quint64 count() const { return n; }
+        qint64 total() const { return sum; }
+        qint64 min() const { return n ? lo : 0; }
+        qint64 max() const { return hi; }
+        double mean() const { return n ? double(sum)/double(n) : 0.; }
+        qint64 percentile(double p) const; // upper bound of the bucket holding the p-th sample
+        quint64 countBelow(quint64 bound) const; // samples in buckets entirely below bound; exact for powers of two
+    private:
+        friend class AtomicHistogram;
+        static int bucketOf(quint64 v);
+        static quint64 bucketUpper(int b);
+        quint64 buckets[NBuckets];
+        quint64 n;
+        qint64 sum, lo, hi;
+    };
+
+    void record(Phase phase, qint64 ns);
+    Histogram histogram(Phase phase);
+    void addBytes(qint64 nbytes); // response body bytes received, after any decompression
+    void addWireBytes(qint64 nbytes); // ... as they came over the wire, compressed or not
+    void count(Counter c, qint64 n = 1);
+    qint64 counter(Counter c);
+    void setGauge(Gauge g, qint64 value);
+    qint64 gauge(Gauge g);
+    void sample(Series s, double value); // a gauge's new value as of now
+
+    QStringList summaryLines();
+    QByteArray toJson();
+    QByteArray prometheusText(); // Prometheus text exposition format 0.0.4
+    bool saveJson(const QString & fileName);
+
+    /// Times its own lifetime into a phase, and into a trace span when tracing is on.
+    /// Heap allocations made on this thread meanwhile are charged to the phase (see AllocTrack).
+    class Scope
+    {
+    public:
+        explicit Scope(Phase p) : phase(p), prevSlot(AllocTrack::setSlot(p)), t0(nowNs()) {}
+        ~Scope() {
+            const qint64 t1 = nowNs();
+            record(phase, t1 - t0);
+            if (Trace::enabled()) Trace::complete(phaseName(phase), t0, t1);
+            AllocTrack::setSlot(prevSlot);
+        }
+    private:
+        Q_DISABLE_COPY(Scope)
+        const Phase phase;
+        const int prevSlot;
+        const qint64 t0;
+    };
+}
+
+#endif // PERF_H
@@ -0,0 +1,98 @@
+#include "Pipeline.h"
+#include "Trace.h"
+#include <QMutexLocker>
+#include <algorithm>
+
+Pipeline::Pipeline(int nParsers, int d, const StageFn & parse, const StageFn & ingest)
+    : depth(std::max(1, d)), parseFn(parse), ingestFn(ingest), stopping(false)
+{
+    for (int i = 0; i < std::max(1, nParsers); ++i) {
+        parsers.emplace_back(new Parser(depth));
+        parsers.back()->name = "parse-" + QByteArray::number(i);
+    }
+    for (auto & p : parsers) {
+        Parser *pp = p.get();
+        p->thread = std::thread([this,pp]{ parseLoop(*pp); });
+    }
+    ingestThread = std::thread([this]{ ingestLoop(); });
+}
+
+Pipeline::~Pipeline()
+{
+    stopping = true;
+    for (auto & p : parsers) {
+        p->inReady.release();
+        p->outSpace.release();
+    }
+    ingestReady.release();
+    for (auto & p : parsers) p->thread.join();
+    ingestThread.join();
+}
+
+bool Pipeline::submit(Page && p)
+{
+    p.bytes = p.body.size();
+    for (size_t k = 0; k < parsers.size(); ++k) {
+        Parser & parser = *parsers[(nextParser + k) % parsers.size()];
+        if (parser.in.push(std::move(p))) {
+            parser.inReady.release();
+            nextParser = (nextParser + k + 1) % parsers.size();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Pipeline::runOnIngestThread(const std::function<void()> & fn)
+{
+    QSemaphore done;
+    {
+        QMutexLocker l(&taskMut);
+        tasks.append([&fn,&done]{ fn(); done.release(); });
+    }
+    ingestReady.release();
+    done.acquire();
+}
+
+void Pipeline::parseLoop(Parser & p)
+{
+    Trace::setThreadName(p.name.constData());
+    for (;;) {
+        p.inReady.acquire();
+        if (stopping) return;
+        Page page;
+        p.in.pop(page);
+        parseFn(page);
+        page.body.clear();
+        p.outSpace.acquire(); // backpressure: wait for the ingest thread to catch up
+        if (stopping) return;
+        p.out.push(std::move(page));
+        ingestReady.release();
+    }
+}
+
+void Pipeline::ingestLoop()
+{
+    Trace::setThreadName("ingest");
+    size_t next = 0;
+    for (;;) {
+        ingestReady.acquire();
+        if (stopping) return;
+        std::function<void()> task;
+        {
+            QMutexLocker l(&taskMut);
+            if (!tasks.isEmpty()) task = tasks.takeFirst();
+        }
+        if (task) {
+            task();
+            continue;
+        }
+        // the permit stands for a page in one of the output queues; take them round-robin
+        Page page;
+        for (;; next = (next + 1) % parsers.size())
+            if (parsers[next]->out.pop(page)) break;
+        parsers[next]->outSpace.release();
+        next = (next + 1) % parsers.size();
+        ingestFn(page);
+    }
+}
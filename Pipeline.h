@@ -0,0 +1,74 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QSemaphore>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Block.h"
+#include "SpscQueue.h"
+
+/// Staged page processing for --threads. The event loop thread submits raw pages, which go
+/// over SPSC queues to a pool of parser threads; their output goes over SPSC queues to a
+/// single ingest thread, so the block store only ever has one writer and CPU-bound parsing
+/// doesn't hold up network I/O on the event loop.
+///
+/// Every queue is bounded. A parser whose output queue is full waits for the ingest thread,
+/// and submit() fails once every parser's input queue is full; the caller is then expected
+/// to stop fetching until pages drain (see Fetcher::setHold()).
+class Pipeline
+{
+public:
+    struct Page
+    {
+        int tag = 0;      // the caller's label for the page
+        QByteArray body;  // raw response
+        BlockList blocks; // filled in by the parse stage
+        QString error;    // ... or this, if the page is unusable
+        qint64 bytes = 0; // body size, kept after the body itself is released
+    };
+    typedef std::function<void(Page &)> StageFn;
+
+    /// parse runs on the parser threads, ingest on the ingest thread (and may post results back).
+    Pipeline(int parsers, int depth, const StageFn & parse, const StageFn & ingest);
+    ~Pipeline(); // pages still queued are dropped
+
+    int capacity() const { return int(parsers.size()) * depth; } // pages the parse stage can hold
+    /// Event loop thread only. Returns false, leaving p alone, if every parser is backed up.
+    bool submit(Page && p);
+    /// Runs fn on the ingest thread between two pages and waits for it, for anything that
+    /// must see the store in a consistent state (checkpoints).
+    void runOnIngestThread(const std::function<void()> & fn);
+
+private:
+    struct Parser
+    {
+        Parser(int depth) : in(size_t(depth)), out(size_t(depth)), outSpace(depth) {}
+        SpscQueue<Page> in, out;
+        QSemaphore inReady;  // pages in `in`
+        QSemaphore outSpace; // free slots in `out`
+        QByteArray name;     // for the trace
+        std::thread thread;
+    };
+
+    void parseLoop(Parser & p);
+    void ingestLoop();
+
+    const int depth;
+    const StageFn parseFn, ingestFn;
+    std::vector<std::unique_ptr<Parser>> parsers;
+    size_t nextParser = 0;   // round-robin start for submit()
+    QSemaphore ingestReady;  // one per page waiting in some `out`, plus one per task
+    QMutex taskMut;
+    QList<std::function<void()>> tasks;
+    std::atomic<bool> stopping;
+    std::thread ingestThread;
+};
+
+#endif // PIPELINE_H
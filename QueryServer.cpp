@@ -0,0 +1,173 @@
+#include "QueryServer.h"
+#include "Perf.h"
+#include <QTcpSocket>
+#include <algorithm>
+#include <limits>
+
+namespace {
+    const qint64 StatsCutoff = 7ll*60ll+30ll; // same as the run summary
+    const int DefaultLimit = 1000, MaxLimit = 10000;
+
+    void appendBlock(QByteArray & out, const QueryServer::Snapshot::Entry & e)
+    {
+        out += "{\"height\":";
+        out += QByteArray::number(e.height);
+        out += ",\"time\":";
+        out += QByteArray::number(e.time);
+        out += ",\"hash\":\"";
+        out += e.hash;
+        out += "\"}";
+    }
+
+    HttpResponse json(int status, const QByteArray & body)
+    {
+        HttpResponse r;
+        r.status = status;
+        r.body = body;
+        return r;
+    }
+
+    qint64 param(const HttpRequest & req, const char *name, qint64 dflt, bool *ok)
+    {
+        const QByteArray v = req.queryValue(name);
+        if (v.isEmpty()) return dflt;
+        bool good;
+        const qint64 ret = v.toLongLong(&good);
+        if (!good) *ok = false;
+        return ret;
+    }
+}
+
+QueryServer::QueryServer(int threads, QObject *parent) : HttpServer(parent)
+{
+    setWorkerThreads(threads);
+    std::atomic_store(&current, std::shared_ptr<const Snapshot>(std::make_shared<Snapshot>()));
+}
+
+bool QueryServer::start(const QHostAddress & address, quint16 port)
+{
+    return listen(address, port);
+}
+
+void QueryServer::publish(const BlockStore & store)
+{
+    std::shared_ptr<Snapshot> s = std::make_shared<Snapshot>();
+    const BlockMap & byHeight = store.byHeight();
+    s->blocks.reserve(byHeight.size());
+    s->byHash.reserve(byHeight.size());
+    for (const Block & b : byHeight) {
+        s->byHash.insert(b.hash.toLatin1(), int(s->blocks.size()));
+        s->blocks.push_back(Snapshot::Entry{b.height, b.time, b.hash.toLatin1()});
+    }
+    s->byTime.resize(s->blocks.size());
+    for (size_t i = 0; i < s->byTime.size(); ++i) s->byTime[i] = int(i);
+    std::sort(s->byTime.begin(), s->byTime.end(), [&s](int a, int b) {
+        const Snapshot::Entry & x = s->blocks[size_t(a)], & y = s->blocks[size_t(b)];
+        return x.time != y.time ? x.time < y.time : x.height < y.height;
+    });
+    s->intervals.build(store.byTime().times());
+    s->cutoffSums.assign(1, 0);
+    s->cutoffCounts.assign(1, 0);
+    qint64 last = -1;
+    s->intervals.timeColumn().scan([&](qint64 t) {
+        if (last > -1) {
+            const qint64 d = t - last;
+            s->cutoffSums.push_back(s->cutoffSums.back() + (d >= StatsCutoff ? d - StatsCutoff : 0));
+            s->cutoffCounts.push_back(s->cutoffCounts.back() + (d >= StatsCutoff ? 1 : 0));
+        }
+        last = t;
+    });
+    s->generation = ++generation;
+    std::atomic_store(&current, std::shared_ptr<const Snapshot>(s));
+}
+
+void QueryServer::handle(QTcpSocket *s, const HttpRequest & req)
+{
+    const qint64 t0 = Perf::nowNs();
+    const std::shared_ptr<const Snapshot> snap = std::atomic_load(&current);
+    send(s, respond(*snap, req));
+    Perf::record(Perf::Query, Perf::nowNs() - t0);
+}
+
+HttpResponse QueryServer::respond(const Snapshot & snap, const HttpRequest & req) const
+{
+    const QByteArray & path = req.path;
+    bool ok = true;
+    if (path.startsWith("/block/height/")) {
+        const unsigned h = path.mid(14).toUInt(&ok);
+        if (!ok) return json(400, "{\"error\":\"bad height\"}");
+        auto it = std::lower_bound(snap.blocks.begin(), snap.blocks.end(), h,
+                                   [](const Snapshot::Entry & e, unsigned v) { return e.height < v; });
+        if (it == snap.blocks.end() || it->height != h) return json(404, "{\"error\":\"no such block\"}");
+        QByteArray out;
+        appendBlock(out, *it);
+        return json(200, out);
+    }
+    if (path.startsWith("/block/hash/")) {
+        auto it = snap.byHash.constFind(path.mid(12).toLower());
+        if (it == snap.byHash.constEnd()) return json(404, "{\"error\":\"no such block\"}");
+        QByteArray out;
+        appendBlock(out, snap.blocks[size_t(*it)]);
+        return json(200, out);
+    }
+    if (path == "/blocks") {
+        const qint64 from = param(req, "from", std::numeric_limits<qint64>::min(), &ok);
+        const qint64 to = param(req, "to", std::numeric_limits<qint64>::max(), &ok);
+        const qint64 limit = std::min(qint64(MaxLimit), param(req, "limit", DefaultLimit, &ok));
+        if (!ok || limit < 0) return json(400, "{\"error\":\"bad from, to or limit\"}");
+        auto it = std::lower_bound(snap.byTime.begin(), snap.byTime.end(), from,
+                                   [&snap](int i, qint64 t) { return snap.blocks[size_t(i)].time < t; });
+        QByteArray out("{\"blocks\":[");
+        out.reserve(int(std::min<qint64>(limit, 256)) * 110 + 32);
+        qint64 n = 0;
+        for (; it != snap.byTime.end() && snap.blocks[size_t(*it)].time < to && n < limit; ++it, ++n) {
+            if (n) out += ',';
+            appendBlock(out, snap.blocks[size_t(*it)]);
+        }
+        const bool more = it != snap.byTime.end() && snap.blocks[size_t(*it)].time < to;
+        out += more ? "],\"more\":true}" : "],\"more\":false}";
+        return json(200, out);
+    }
+    if (path == "/stats") {
+        const qint64 from = param(req, "from", std::numeric_limits<qint64>::min(), &ok);
+        const qint64 to = param(req, "to", std::numeric_limits<qint64>::max(), &ok);
+        if (!ok) return json(400, "{\"error\":\"bad from or to\"}");
+        return rangeStats(snap, from, to);
+    }
+    if (path == "/health") {
+        QByteArray out = "{\"blocks\":" + QByteArray::number(qulonglong(snap.blocks.size()));
+        if (!snap.blocks.empty())
+            out += ",\"min_height\":" + QByteArray::number(snap.blocks.front().height)
+                   + ",\"max_height\":" + QByteArray::number(snap.blocks.back().height);
+        out += ",\"generation\":" + QByteArray::number(snap.generation) + "}";
+        return json(200, out);
+    }
+    return json(404, "{\"error\":\"not found\"}");
+}
+
+HttpResponse QueryServer::rangeStats(const Snapshot & snap, qint64 from, qint64 to) const
+{
+    const TimeColumn & times = snap.intervals.timeColumn();
+    const size_t a = times.lowerBound(from), b = times.lowerBound(to); // distinct times [a, b)
+    auto lo = std::lower_bound(snap.byTime.begin(), snap.byTime.end(), from,
+                               [&snap](int i, qint64 t) { return snap.blocks[size_t(i)].time < t; });
+    auto hi = std::lower_bound(lo, snap.byTime.end(), to,
+                               [&snap](int i, qint64 t) { return snap.blocks[size_t(i)].time < t; });
+    const qint64 nBlocks = hi - lo;
+    QByteArray out = "{\"blocks\":" + QByteArray::number(nBlocks);
+    if (b > a + 1) {
+        // intervals a .. b-2 join the distinct times in range; their lengths sum to the span
+        const qint64 cutoffN = snap.cutoffCounts[b - 1] - snap.cutoffCounts[a];
+        const qint64 cutoffSum = snap.cutoffSums[b - 1] - snap.cutoffSums[a];
+        out += ",\"intervals\":" + QByteArray::number(qulonglong(b - a - 1));
+        out += ",\"avg_secs\":" + QByteArray::number(double(times.at(b - 1) - times.at(a)) / double(nBlocks), 'f', 3);
+        out += ",\"min_secs\":" + QByteArray::number(snap.intervals.quantile(from, to, 0.));
+        out += ",\"median_secs\":" + QByteArray::number(snap.intervals.quantile(from, to, 0.5));
+        out += ",\"p99_secs\":" + QByteArray::number(snap.intervals.quantile(from, to, 0.99));
+        out += ",\"max_secs\":" + QByteArray::number(snap.intervals.quantile(from, to, 1.));
+        out += ",\"cutoff_secs\":" + QByteArray::number(StatsCutoff);
+        out += ",\"cutoff_avg_secs\":" + QByteArray::number(cutoffN ? double(cutoffSum) / double(cutoffN) : 0., 'f', 3);
+    }
+    out += ",\"generation\":" + QByteArray::number(snap.generation) + "}";
+    return json(200, out);
+}
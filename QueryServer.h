@@ -0,0 +1,52 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include "HttpServer.h"
+#include "BlockStore.h"
+#include "Stats.h"
+#include <QHostAddress>
+#include <memory>
+#include <vector>
+
+/// Read-only JSON queries over the downloaded blocks (--serve):
+///
+///     /block/height/<h>               one block
+///     /block/hash/<hash>              one block
+///     /blocks?from=<t>&to=<t>&limit=n blocks with from <= time < to, oldest first (at most 10000)
+///     /stats?from=<t>&to=<t>          interval stats over that time range (default: everything)
+///     /health                         block count, height range, snapshot generation
+///
+/// Requests are answered from an immutable snapshot with sorted and hashed indexes, so worker
+/// threads read it concurrently without locks. publish() builds a new snapshot off to the side
+/// and swaps it in atomically; requests already running finish on the old one.
+class QueryServer : public HttpServer
+{
+public:
+    explicit QueryServer(int threads, QObject *parent = nullptr);
+
+    bool start(const QHostAddress & address, quint16 port);
+    void publish(const BlockStore & store);
+
+    struct Snapshot
+    {
+        struct Entry { unsigned height; qint64 time; QByteArray hash; };
+        std::vector<Entry> blocks;          // by height
+        QHash<QByteArray, int> byHash;      // -> index into blocks
+        std::vector<int> byTime;            // indexes into blocks, ordered by (time, height)
+        IntervalIndex intervals;            // over the distinct timestamps
+        std::vector<qint64> cutoffSums, cutoffCounts; // prefix sums over intervals, for the cutoff test
+        quint64 generation = 0;
+    };
+
+protected:
+    void handle(QTcpSocket *s, const HttpRequest & req) override;
+
+private:
+    HttpResponse respond(const Snapshot & snap, const HttpRequest & req) const;
+    HttpResponse rangeStats(const Snapshot & snap, qint64 from, qint64 to) const;
+
+    std::shared_ptr<const Snapshot> current; // only touched through std::atomic_load/atomic_store
+    quint64 generation = 0;
+};
+
+#endif // QUERYSERVER_H
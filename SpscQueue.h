@@ -0,0 +1,48 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/// Bounded single-producer, single-consumer ring buffer. push() and pop() never block or
+/// allocate; each side writes only its own index and reads the other's with acquire, so
+/// the one slot's contents are handed over without a lock.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity) : buf(capacity + 1), head(0), tail(0) {}
+
+    size_t capacity() const { return buf.size() - 1; }
+
+    /// Producer side. Returns false (and leaves v alone) if the queue is full.
+    bool push(T && v)
+    {
+        const size_t t = tail.load(std::memory_order_relaxed), n = next(t);
+        if (n == head.load(std::memory_order_acquire)) return false;
+        buf[t] = std::move(v);
+        tail.store(n, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side. Returns false if the queue is empty.
+    bool pop(T & v)
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        v = std::move(buf[h]);
+        head.store(next(h), std::memory_order_release);
+        return true;
+    }
+
+private:
+    size_t next(size_t i) const { return i + 1 == buf.size() ? 0 : i + 1; }
+
+    std::vector<T> buf;
+    alignas(64) std::atomic<size_t> head; // next slot to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail; // next slot to push, written by the producer
+};
+
+#endif // SPSCQUEUE_H
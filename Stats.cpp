@@ -0,0 +1,199 @@
+#include "Stats.h"
+#include "TaskPool.h"
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <QSet>
+
+IntervalStats computeIntervalStats(const TimeColumn & times, int nBlocks, int nDupeTimes, qint64 cutoff)
+{
+    IntervalStats s;
+    s.nBlocks = nBlocks;
+    s.cutoff = cutoff;
+    double avg = 0.;
+    qint64 last = -1, min = nDupeTimes ? 0ll : LLONG_MAX, max = -1;
+    times.scan([&](qint64 t) {
+        if (last > -1) {
+            const qint64 delta = t-last; // > 0: the times are distinct and sorted
+            avg += double(delta) / double(nBlocks>0?nBlocks:1);
+            if (delta < min) min = delta;
+            if (delta > max) max = delta;
+            if (delta >= cutoff) {
+                s.cutoffDeltaSums += delta-cutoff;
+                ++s.nCutoff;
+            }
+        }
+        last = t;
+    });
+    s.avg = avg;
+    s.min = min;
+    s.max = max;
+    return s;
+}
+
+namespace {
+    struct PartialStats
+    {
+        qint64 sum = 0, min = LLONG_MAX, max = -1, cutoffDeltaSums = 0, nCutoff = 0;
+    };
+}
+
+IntervalStats computeIntervalStats(const TimeColumn & times, int nBlocks, int nDupeTimes, qint64 cutoff, TaskPool & pool)
+{
+    static const size_t GrainChunks = 64; // 8192 timestamps per task
+    const size_t nChunks = times.chunkCount();
+    const PartialStats total = parallelReduce(pool, 0, nChunks, GrainChunks, PartialStats(), [&](size_t c0, size_t c1) {
+        PartialStats r;
+        qint64 last = -1;
+        auto add = [&](qint64 t) {
+            if (last > -1) {
+                const qint64 delta = t-last;
+                r.sum += delta;
+                if (delta < r.min) r.min = delta;
+                if (delta > r.max) r.max = delta;
+                if (delta >= cutoff) {
+                    r.cutoffDeltaSums += delta-cutoff;
+                    ++r.nCutoff;
+                }
+            }
+            last = t;
+        };
+        qint64 buf[TimeColumn::ChunkSize];
+        for (size_t c = c0; c < c1; ++c) {
+            const size_t n = times.decodeChunk(c, buf);
+            for (size_t i = 0; i < n; ++i) add(buf[i]);
+        }
+        if (c1 < nChunks) add(times.chunkFirst(c1)); // the interval joining this run to the next
+        return r;
+    }, [](const PartialStats & a, const PartialStats & b) {
+        PartialStats r;
+        r.sum = a.sum + b.sum;
+        r.min = std::min(a.min, b.min);
+        r.max = std::max(a.max, b.max);
+        r.cutoffDeltaSums = a.cutoffDeltaSums + b.cutoffDeltaSums;
+        r.nCutoff = a.nCutoff + b.nCutoff;
+        return r;
+    });
+    IntervalStats s;
+    s.nBlocks = nBlocks;
+    s.cutoff = cutoff;
+    s.avg = double(total.sum) / double(nBlocks>0?nBlocks:1);
+    s.min = nDupeTimes ? std::min(qint64(0), total.min) : total.min;
+    s.max = total.max;
+    s.cutoffDeltaSums = total.cutoffDeltaSums;
+    s.nCutoff = total.nCutoff;
+    return s;
+}
+
+void IntervalIndex::build(const TimeColumn & t)
+{
+    times = t;
+    // the distinct intervals first (a few thousand), then each interval as an index into them
+    QSet<qint64> distinct;
+    qint64 last = -1;
+    times.scan([&](qint64 v) {
+        if (last > -1) distinct.insert(v - last);
+        last = v;
+    });
+    std::vector<qint64> alphabet(distinct.begin(), distinct.end());
+    std::sort(alphabet.begin(), alphabet.end());
+    std::vector<quint32> symbols;
+    symbols.reserve(times.size());
+    last = -1;
+    times.scan([&](qint64 v) {
+        if (last > -1)
+            symbols.push_back(quint32(std::lower_bound(alphabet.begin(), alphabet.end(), v - last) - alphabet.begin()));
+        last = v;
+    });
+    intervals.build(std::move(alphabet), std::move(symbols));
+}
+
+qint64 IntervalIndex::quantile(qint64 from, qint64 to, double q) const
+{
+    const size_t a = times.lowerBound(from), b = times.lowerBound(to);
+    if (b <= a + 1) return -1;
+    return intervals.quantile(a, b - 1, q);
+}
+
+void RunningStats::reset(const TimeColumn & sortedTimes, int nDupeTimes)
+{
+    times.clear();
+    std::fill(fenwick.begin(), fenwick.end(), 0u);
+    longIntervals.clear();
+    nIntervals = 0;
+    cutoffDeltaSums = nCutoff = 0;
+    nDupes = nDupeTimes;
+    sortedTimes.scan([this](qint64 t) { addTime(t); });
+}
+
+void RunningStats::addTime(qint64 t)
+{
+    if (times.empty() || t > *times.rbegin()) { // the usual case: the new tip
+        if (!times.empty()) addInterval(t - *times.rbegin(), +1);
+        times.insert(times.end(), t);
+        return;
+    }
+    auto next = times.lower_bound(t);
+    if (next != times.end() && *next == t) return;
+    if (next != times.begin()) {
+        auto prev = std::prev(next);
+        addInterval(*next - *prev, -1);
+        addInterval(t - *prev, +1);
+    }
+    addInterval(*next - t, +1);
+    times.insert(next, t);
+}
+
+void RunningStats::addInterval(qint64 d, int sign)
+{
+    if (d >= cutoff) {
+        cutoffDeltaSums += sign * (d - cutoff);
+        nCutoff += sign;
+    }
+    nIntervals += sign;
+    if (d >= FenwickSize) {
+        if (sign > 0) longIntervals.insert(d);
+        else longIntervals.erase(longIntervals.find(d));
+        return;
+    }
+    for (size_t i = size_t(d) + 1; i <= FenwickSize; i += i & (~i + 1))
+        fenwick[i] += quint32(sign);
+}
+
+qint64 RunningStats::kth(quint64 k) const
+{
+    // descend the Fenwick tree for the first length whose cumulative count reaches k
+    quint64 pos = 0, remaining = k;
+    for (int step = FenwickSize; step; step >>= 1)
+        if (pos + step <= FenwickSize && fenwick[pos + step] < remaining) {
+            pos += step;
+            remaining -= fenwick[pos];
+        }
+    if (pos < FenwickSize) return qint64(pos);
+    auto it = longIntervals.begin();
+    std::advance(it, qint64(remaining) - 1); // the long tail is a handful of entries at most
+    return *it;
+}
+
+IntervalStats RunningStats::stats() const
+{
+    IntervalStats s;
+    s.nBlocks = int(times.size()) + nDupes;
+    s.cutoff = cutoff;
+    // intervals between consecutive distinct times sum to the total span
+    s.avg = times.size() > 1 ? double(*times.rbegin() - *times.begin()) / double(s.nBlocks) : 0.;
+    s.min = nDupes ? 0 : (nIntervals ? kth(1) : LLONG_MAX);
+    s.max = nIntervals ? (longIntervals.empty() ? kth(nIntervals) : *longIntervals.rbegin()) : -1;
+    s.cutoffDeltaSums = cutoffDeltaSums;
+    s.nCutoff = nCutoff;
+    return s;
+}
+
+qint64 RunningStats::quantile(double q) const
+{
+    if (!nIntervals) return -1;
+    const quint64 k = std::min(nIntervals, std::max(quint64(1), quint64(std::ceil(q * double(nIntervals)))));
+    return kth(k);
+}
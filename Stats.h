@@ -0,0 +1,76 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "Block.h"
+#include "TimeColumn.h"
+#include "WaveletTree.h"
+#include <set>
+#include <vector>
+
+class TaskPool;
+
+struct IntervalStats
+{
+    int nBlocks = 0;        // including duplicate timestamps
+    double avg = 0.;        // seconds
+    qint64 min = 0, max = 0;
+    qint64 cutoff = 0;      // Craig vs Peter R test: intervals >= cutoff contribute (interval - cutoff)
+    qint64 cutoffDeltaSums = 0, nCutoff = 0;
+};
+
+/// One pass over the distinct block times, sorted ascending. Duplicate timestamps count as zero-length intervals.
+IntervalStats computeIntervalStats(const TimeColumn & times, int nBlocks, int nDupeTimes, qint64 cutoff);
+/// The same, with runs of whole TimeColumn chunks decoded and summed in parallel on pool.
+IntervalStats computeIntervalStats(const TimeColumn & times, int nBlocks, int nDupeTimes, qint64 cutoff, TaskPool & pool);
+
+/// Sorted block times plus a wavelet tree over the intervals between them, for
+/// order statistics over arbitrary time ranges.
+class IntervalIndex
+{
+public:
+    /// Keeps a copy of times (the compressed bytes; nothing is decoded for it).
+    void build(const TimeColumn & times);
+    void clear() { times.clear(); intervals.clear(); }
+
+    const TimeColumn & timeColumn() const { return times; }
+    bool isEmpty() const { return intervals.isEmpty(); }
+    /// Quantile q of the intervals between consecutive blocks whose timestamps both lie in [from, to),
+    /// or -1 if there are none.
+    qint64 quantile(qint64 from, qint64 to, double q) const;
+
+private:
+    TimeColumn times;
+    WaveletTree intervals; // intervals[i] = times[i+1] - times[i]
+};
+
+/// The same statistics as computeIntervalStats, plus quantiles, kept current as blocks arrive
+/// one at a time (--watch). A block newer than all others is an append; an out-of-order one
+/// splits an existing interval in two. Either way an update touches a constant number of
+/// intervals, each costing one walk of a 16-level Fenwick tree of interval lengths.
+class RunningStats
+{
+public:
+    explicit RunningStats(qint64 cutoff) : cutoff(cutoff) {}
+
+    void reset(const TimeColumn & sortedTimes, int nDupeTimes); // O(n); sortedTimes as in BlockStore::byTime()
+    void addTime(qint64 t);   // a block with a timestamp not seen before
+    void addDupe() { ++nDupes; } // a block whose timestamp was already known
+
+    IntervalStats stats() const;
+    qint64 quantile(double q) const; // nearest rank, like IntervalIndex::quantile; -1 if no intervals
+
+private:
+    enum { FenwickBits = 16, FenwickSize = 1 << FenwickBits }; // intervals of 18h+ go to `long`
+    void addInterval(qint64 d, int sign);
+    qint64 kth(quint64 k) const; // 1-based
+
+    const qint64 cutoff;
+    std::set<qint64> times;
+    std::vector<quint32> fenwick = std::vector<quint32>(FenwickSize + 1);
+    std::multiset<qint64> longIntervals;
+    quint64 nIntervals = 0;
+    int nDupes = 0;
+    qint64 cutoffDeltaSums = 0, nCutoff = 0;
+};
+
+#endif // STATS_H
@@ -0,0 +1,253 @@
+#include "TaskPool.h"
+#include "Trace.h"
+#include <QByteArray>
+
+/// Chase-Lev deque (in the C11 formulation of Le, Pop, Cohen and Zappa Nardelli, PPoPP'13).
+/// The owner pushes and pops at the bottom without locking; thieves take from the top with a
+/// CAS that only contends when one element is left. Outgrown arrays are kept until the deque
+/// dies, since a thief may still be reading one.
+class TaskPool::WorkDeque
+{
+public:
+    WorkDeque() : top(0), bottom(0), array(new Array(256)) { arrays.emplace_back(array.load()); }
+
+    void push(Task *t) // owner only
+    {
+        const qint64 b = bottom.load(std::memory_order_relaxed), tp = top.load(std::memory_order_acquire);
+        Array *a = array.load(std::memory_order_relaxed);
+        if (b - tp > qint64(a->size) - 1) a = grow(a, tp, b);
+        a->put(b, t);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    Task *pop() // owner only
+    {
+        const qint64 b = bottom.load(std::memory_order_relaxed) - 1;
+        Array *a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        qint64 tp = top.load(std::memory_order_relaxed);
+        if (tp > b) { // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Task *t = a->get(b);
+        if (tp == b) { // last one: race the thieves for it
+            if (!top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                t = nullptr;
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return t;
+    }
+
+    Task *steal() // any thread
+    {
+        qint64 tp = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const qint64 b = bottom.load(std::memory_order_acquire);
+        if (tp >= b) return nullptr;
+        Task *t = array.load(std::memory_order_acquire)->get(tp);
+        if (!top.compare_exchange_strong(tp, tp + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return nullptr; // lost to the owner or another thief
+        return t;
+    }
+
+private:
+    struct Array
+    {
+        explicit Array(size_t n) : size(n), slots(new std::atomic<Task *>[n]) {}
+        Task *get(qint64 i) const { return slots[size_t(i) & (size - 1)].load(std::memory_order_relaxed); }
+        void put(qint64 i, Task *t) { slots[size_t(i) & (size - 1)].store(t, std::memory_order_relaxed); }
+        const size_t size; // a power of two
+        std::unique_ptr<std::atomic<Task *>[]> slots;
+    };
+
+    Array *grow(Array *a, qint64 tp, qint64 b)
+    {
+        Array *bigger = new Array(a->size * 2);
+        for (qint64 i = tp; i < b; ++i) bigger->put(i, a->get(i));
+        arrays.emplace_back(bigger);
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<qint64> top;
+    alignas(64) std::atomic<qint64> bottom;
+    std::atomic<Array *> array;
+    std::vector<std::unique_ptr<Array>> arrays; // owner only
+};
+
+struct TaskPool::Worker
+{
+    WorkDeque deque;
+    std::thread thread;
+    QByteArray name; // for the trace
+};
+
+namespace {
+    thread_local TaskPool *currentPool = nullptr;
+    thread_local int currentIndex = -1;
+    thread_local quint32 stealSeed = 0x9e3779b9u;
+
+    quint32 nextRandom()
+    {
+        quint32 x = stealSeed; // xorshift32
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return stealSeed = x;
+    }
+}
+
+TaskPool::TaskPool(int threads) : epoch(0), sleepers(0), stopping(false)
+{
+    if (threads <= 0) threads = int(std::max(1u, std::thread::hardware_concurrency()));
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back(new Worker);
+        workers.back()->name = "pool-" + QByteArray::number(i);
+    }
+    for (int i = 0; i < threads; ++i)
+        workers[size_t(i)]->thread = std::thread([this,i]{ workerLoop(i); });
+}
+
+TaskPool::~TaskPool()
+{
+    stopping = true;
+    wake(true);
+    for (auto & w : workers) w->thread.join();
+    for (auto & w : workers)
+        while (Task *t = w->deque.pop()) delete t;
+    for (Task *t : injected) delete t;
+}
+
+TaskPool & TaskPool::global()
+{
+    static TaskPool pool;
+    return pool;
+}
+
+void TaskPool::submit(Task t)
+{
+    Task *task = new Task(std::move(t));
+    if (currentPool == this) {
+        workers[size_t(currentIndex)]->deque.push(task);
+    } else {
+        std::lock_guard<std::mutex> l(injectMut);
+        injected.push_back(task);
+    }
+    wake(false);
+}
+
+void TaskPool::wake(bool all)
+{
+    // pairs with the epoch check in workerLoop/helpUntil: either a sleeper sees the new epoch
+    // before it blocks, or we see it counted in sleepers and notify it
+    epoch.fetch_add(1, std::memory_order_seq_cst);
+    if (sleepers.load(std::memory_order_seq_cst) > 0) {
+        std::lock_guard<std::mutex> l(sleepMut);
+        if (all) sleepCv.notify_all();
+        else sleepCv.notify_one();
+    }
+}
+
+TaskPool::Task *TaskPool::findTask(int self)
+{
+    if (self >= 0)
+        if (Task *t = workers[size_t(self)]->deque.pop()) return t;
+    {
+        std::lock_guard<std::mutex> l(injectMut);
+        if (!injected.empty()) {
+            Task *t = injected.front();
+            injected.pop_front();
+            return t;
+        }
+    }
+    const size_t n = workers.size(), start = nextRandom() % n;
+    for (size_t k = 0; k < n; ++k) {
+        const size_t victim = (start + k) % n;
+        if (int(victim) == self) continue;
+        if (Task *t = workers[victim]->deque.steal()) return t;
+    }
+    return nullptr;
+}
+
+void TaskPool::runTask(Task *t)
+{
+    (*t)();
+    delete t;
+}
+
+void TaskPool::workerLoop(int index)
+{
+    currentPool = this;
+    currentIndex = index;
+    stealSeed ^= quint32(index + 1) * 0x85ebca6bu;
+    Trace::setThreadName(workers[size_t(index)]->name.constData());
+    for (;;) {
+        const quint64 e = epoch.load(std::memory_order_seq_cst);
+        if (Task *t = findTask(index)) {
+            runTask(t);
+            continue;
+        }
+        if (stopping) return;
+        std::unique_lock<std::mutex> l(sleepMut);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        while (epoch.load(std::memory_order_seq_cst) == e && !stopping) sleepCv.wait(l);
+        sleepers.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+void TaskPool::helpUntil(const std::function<bool()> & done)
+{
+    const int self = currentPool == this ? currentIndex : -1;
+    while (!done()) {
+        const quint64 e = epoch.load(std::memory_order_seq_cst);
+        if (Task *t = findTask(self)) {
+            runTask(t);
+            continue;
+        }
+        std::unique_lock<std::mutex> l(sleepMut);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        while (epoch.load(std::memory_order_seq_cst) == e && !done()) sleepCv.wait(l);
+        sleepers.fetch_sub(1, std::memory_order_seq_cst);
+    }
+}
+
+TaskGroup::TaskGroup(TaskPool & p) : pool(p), state(std::make_shared<State>()) {}
+
+void TaskGroup::run(TaskPool::Task t)
+{
+    state->pending.fetch_add(1, std::memory_order_relaxed);
+    std::shared_ptr<State> s = state;
+    TaskPool *p = &pool;
+    pool.submit([s,p,t]{
+        t();
+        if (s->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        std::vector<TaskPool::Task> next;
+        {
+            std::lock_guard<std::mutex> l(s->mut);
+            next.swap(s->continuations);
+        }
+        for (TaskPool::Task & c : next) p->submit(std::move(c));
+        p->wake(true); // whoever is waiting on the group
+    });
+}
+
+void TaskGroup::then(TaskPool::Task t)
+{
+    {
+        std::lock_guard<std::mutex> l(state->mut);
+        if (state->pending.load(std::memory_order_acquire) > 0) {
+            state->continuations.push_back(std::move(t));
+            return;
+        }
+    }
+    pool.submit(std::move(t));
+}
+
+void TaskGroup::wait()
+{
+    std::shared_ptr<State> s = state;
+    pool.helpUntil([s]{ return s->pending.load(std::memory_order_acquire) == 0; });
+}
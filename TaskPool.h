@@ -0,0 +1,125 @@
+#ifndef TASKPOOL_H
+#define TASKPOOL_H
+
+#include <QtGlobal>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+/// Work-stealing thread pool. Every worker owns a Chase-Lev deque: tasks a worker submits go
+/// on its own deque and it runs them newest-first, so nested work stays on the core whose cache
+/// holds its data; idle workers steal the oldest (largest) tasks from the others. Tasks
+/// submitted from outside the pool go through a shared injection queue.
+///
+/// Threads that wait on a TaskGroup run queued tasks meanwhile, so groups nest freely (a task
+/// may itself use parallelFor) without tying up workers.
+class TaskPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    explicit TaskPool(int threads = 0); // 0 = one per core
+    ~TaskPool();                        // runs nothing further; unstarted tasks are dropped
+
+    int size() const { return int(workers.size()); }
+    static TaskPool & global(); // one per core, created on first use
+
+    void submit(Task t);
+
+private:
+    friend class TaskGroup;
+    class WorkDeque;
+    struct Worker;
+
+    void workerLoop(int index);
+    Task *findTask(int self);
+    void runTask(Task *t);
+    /// Runs tasks on the calling thread until done() is true.
+    void helpUntil(const std::function<bool()> & done);
+    void wake(bool all);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injectMut;
+    std::deque<Task *> injected;
+    std::mutex sleepMut;
+    std::condition_variable sleepCv;
+    std::atomic<quint64> epoch;  // bumped on every submit and group completion; sleepers wait for a change
+    std::atomic<int> sleepers;
+    std::atomic<bool> stopping;
+};
+
+/// A set of tasks that can be waited for, or followed by continuations.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(TaskPool & pool = TaskPool::global());
+    ~TaskGroup() { wait(); }
+
+    void run(TaskPool::Task t);
+    /// Submits t once every task run() so far has finished, without blocking the caller.
+    void then(TaskPool::Task t);
+    /// Returns once every task run() so far has finished, running queued tasks meanwhile.
+    void wait();
+
+private:
+    Q_DISABLE_COPY(TaskGroup)
+    struct State
+    {
+        std::atomic<int> pending{0};
+        std::mutex mut;
+        std::vector<TaskPool::Task> continuations;
+    };
+    TaskPool & pool;
+    std::shared_ptr<State> state;
+};
+
+/// Calls body(lo, hi) over subranges of [begin, end) no longer than grain, in parallel.
+/// The range is split in halves recursively, so stealing workers take large pieces.
+template <typename F>
+void parallelFor(TaskPool & pool, size_t begin, size_t end, size_t grain, const F & body)
+{
+    if (grain < 1) grain = 1;
+    if (end <= begin) return;
+    if (end - begin <= grain || pool.size() < 2) {
+        body(begin, end);
+        return;
+    }
+    TaskGroup g(pool);
+    std::function<void(size_t, size_t)> split = [&](size_t lo, size_t hi) {
+        while (hi - lo > grain) {
+            const size_t mid = lo + (hi - lo) / 2;
+            g.run([&split,mid,hi]{ split(mid, hi); });
+            hi = mid;
+        }
+        body(lo, hi);
+    };
+    split(begin, end);
+    g.wait();
+}
+
+/// Maps each grain-sized subrange of [begin, end) to a T in parallel, then folds the results
+/// left to right with combine, so the result doesn't depend on scheduling.
+template <typename T, typename Map, typename Combine>
+T parallelReduce(TaskPool & pool, size_t begin, size_t end, size_t grain, const T & identity,
+                 const Map & map, const Combine & combine)
+{
+    if (grain < 1) grain = 1;
+    if (end <= begin) return identity;
+    const size_t nParts = (end - begin + grain - 1) / grain;
+    std::vector<T> parts(nParts, identity);
+    parallelFor(pool, 0, nParts, 1, [&](size_t lo, size_t hi) {
+        for (size_t p = lo; p < hi; ++p)
+            parts[p] = map(begin + p*grain, std::min(end, begin + (p + 1)*grain));
+    });
+    T acc = identity;
+    for (const T & p : parts) acc = combine(acc, p);
+    return acc;
+}
+
+#endif // TASKPOOL_H
@@ -0,0 +1,165 @@
+#include "TimeColumn.h"
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+    const size_t Padding = 8;
+    const int MaxPackedWidth = 56; // a whole-word load at any bit offset still holds the value; wider goes raw
+}
+
+void TimeColumn::clear()
+{
+    n = 0;
+    lastValue = lastDelta = 0;
+    bytes.clear();
+    skips.clear();
+    open.clear();
+    streamLen = 0;
+}
+
+void TimeColumn::squeeze()
+{
+    bytes.resize(streamLen + Padding);
+    bytes.shrink_to_fit();
+    skips.shrink_to_fit();
+    open.shrink_to_fit();
+}
+
+void TimeColumn::pack()
+{
+    quint64 all = 0;
+    for (quint64 z : open) all |= z;
+    int width = 0;
+    while (width < 64 && (all >> width)) ++width;
+    if (width > MaxPackedWidth) width = 64;
+    skips.back().width = quint32(width);
+
+    const size_t len = (open.size()*size_t(width) + 7) / 8;
+    if (bytes.size() < streamLen + len + Padding)
+        bytes.resize(std::max(bytes.size()*2, streamLen + len + Padding), 0);
+    quint8 *p = bytes.data() + streamLen;
+    if (width == 64) {
+        for (size_t i = 0; i < open.size(); ++i) qToLittleEndian(open[i], p + 8*i);
+    } else {
+        // whole bytes leave the accumulator as soon as they are complete; the word stored
+        // each time also carries the partial byte, so nothing is ever read back
+        quint64 acc = 0;
+        int nbits = 0;
+        for (quint64 z : open) {
+            acc |= z << nbits;
+            nbits += width;
+            qToLittleEndian(acc, p);
+            p += nbits >> 3;
+            acc >>= nbits & ~7;
+            nbits &= 7;
+        }
+    }
+    streamLen += len;
+    open.clear();
+}
+
+void TimeColumn::append(qint64 v)
+{
+    if (n % ChunkSize == 0) {
+        Skip s;
+        s.first = v;
+        s.offset = quint32(streamLen);
+        s.width = 0;
+        skips.push_back(s);
+        lastDelta = 0;
+    } else {
+        const qint64 d = v - lastValue;
+        open.push_back(zigzag(d - lastDelta));
+        lastDelta = d;
+        if (open.size() == ChunkSize - 1) pack();
+    }
+    lastValue = v;
+    ++n;
+}
+
+void TimeColumn::decode(size_t c, size_t m, qint64 *out) const
+{
+    const Skip & s = skips[c];
+    qint64 delta = 0, v = s.first;
+    out[0] = v;
+    if (c + 1 == skips.size() && n % ChunkSize) { // still open
+        for (size_t i = 0; i < m; ++i) {
+            delta += unzigzag(open[i]);
+            v += delta;
+            out[i+1] = v;
+        }
+        return;
+    }
+    const quint8 *p = bytes.data() + s.offset;
+    if (s.width == 64) {
+        for (size_t i = 0; i < m; ++i) {
+            delta += unzigzag(qFromLittleEndian<quint64>(p + 8*i));
+            v += delta;
+            out[i+1] = v;
+        }
+        return;
+    }
+    const size_t width = s.width;
+    const quint64 mask = (quint64(1) << width) - 1;
+    size_t bit = 0;
+    for (size_t i = 0; i < m; ++i, bit += width) {
+        delta += unzigzag((qFromLittleEndian<quint64>(p + (bit >> 3)) >> (bit & 7)) & mask);
+        v += delta;
+        out[i+1] = v;
+    }
+}
+
+size_t TimeColumn::decodeChunk(size_t c, qint64 *out) const
+{
+    const size_t cnt = std::min(size_t(ChunkSize), n - c*ChunkSize);
+    decode(c, cnt - 1, out);
+    return cnt;
+}
+
+qint64 TimeColumn::at(size_t i) const
+{
+    const size_t j = i % ChunkSize;
+    if (!j) return skips[i / ChunkSize].first;
+    qint64 buf[ChunkSize];
+    decode(i / ChunkSize, j, buf);
+    return buf[j];
+}
+
+size_t TimeColumn::lowerBound(qint64 v) const
+{
+    // first chunk whose first value is >= v; the answer is in the chunk before it, or is its start
+    const auto it = std::lower_bound(skips.begin(), skips.end(), v,
+                                     [](const Skip & s, qint64 val) { return s.first < val; });
+    const size_t c = size_t(it - skips.begin());
+    if (!c) return 0;
+    qint64 buf[ChunkSize];
+    const size_t cnt = decodeChunk(c - 1, buf);
+    return (c - 1)*ChunkSize + size_t(std::lower_bound(buf, buf + cnt, v) - buf);
+}
+
+size_t TimeColumn::indexOf(qint64 v) const
+{
+    // as lowerBound, but a chunk's first value needs no decoding
+    const auto it = std::lower_bound(skips.begin(), skips.end(), v,
+                                     [](const Skip & s, qint64 val) { return s.first < val; });
+    const size_t c = size_t(it - skips.begin());
+    if (c < skips.size() && it->first == v) return c*ChunkSize;
+    if (!c) return n;
+    qint64 buf[ChunkSize];
+    const size_t cnt = decodeChunk(c - 1, buf);
+    const qint64 *hit = std::lower_bound(buf, buf + cnt, v);
+    return hit != buf + cnt && *hit == v ? (c - 1)*ChunkSize + size_t(hit - buf) : n;
+}
+
+void TimeColumn::decodeAll(qint64 *out) const
+{
+    for (size_t c = 0; c < skips.size(); ++c)
+        decodeChunk(c, out + c*ChunkSize);
+}
+
+std::vector<qint64> TimeColumn::toVector() const
+{
+    std::vector<qint64> ret(n);
+    if (n) decodeAll(ret.data());
+    return ret;
+}
@@ -0,0 +1,76 @@
+#ifndef TIMECOLUMN_H
+#define TIMECOLUMN_H
+
+#include <QtGlobal>
+#include <vector>
+
+/// Append-only compressed column of qint64 values, such as sorted timestamps.
+///
+/// Values are stored Gorilla-style as zigzag encoded delta-of-deltas, in chunks of
+/// ChunkSize values. Each complete chunk is bit-packed at the width of its largest
+/// delta-of-delta (13-15 bits for real block times), so decoding is a fixed
+/// load/shift/mask per value with no data-dependent branches. Each chunk has a skip
+/// entry (its first value, byte offset and width) so random access decodes at most
+/// one chunk. The chunk being filled is kept unpacked until it is complete.
+class TimeColumn
+{
+public:
+    enum { ChunkSize = 128 };
+
+    TimeColumn() : n(0), lastValue(0), lastDelta(0), streamLen(0) {}
+
+    void append(qint64 v);
+    void clear();
+    void squeeze(); // release excess capacity once the column is complete
+
+    size_t size() const { return n; }
+    bool isEmpty() const { return n == 0; }
+    qint64 at(size_t i) const;
+    qint64 front() const { return skips.front().first; }
+    qint64 back() const { return lastValue; }
+    /// Index of the first value >= v, assuming the column is sorted ascending.
+    size_t lowerBound(qint64 v) const;
+    /// Index of v, assuming the column is sorted ascending; size() if v isn't there.
+    size_t indexOf(qint64 v) const;
+    /// Bytes of heap actually used by the encoded column (packed chunks, open chunk and skip table).
+    size_t bytesUsed() const { return streamLen + open.size()*sizeof(quint64) + skips.size()*sizeof(Skip); }
+
+    /// Decodes chunk c into out (room for ChunkSize values). Returns the number of values decoded.
+    size_t decodeChunk(size_t c, qint64 *out) const;
+    size_t chunkCount() const { return skips.size(); }
+    qint64 chunkFirst(size_t c) const { return skips[c].first; } // without decoding anything
+    /// Decodes the whole column into out, which must have room for size() values.
+    void decodeAll(qint64 *out) const;
+    std::vector<qint64> toVector() const;
+
+    /// Calls f(value) for every value in order.
+    template <typename F> void scan(F && f) const {
+        qint64 buf[ChunkSize];
+        for (size_t c = 0; c < skips.size(); ++c) {
+            const size_t cnt = decodeChunk(c, buf);
+            for (size_t i = 0; i < cnt; ++i) f(buf[i]);
+        }
+    }
+
+private:
+    struct Skip
+    {
+        qint64 first;   // first value of the chunk, stored raw
+        quint32 offset; // byte offset of the chunk's packed delta-of-deltas in bytes
+        quint32 width;  // bits per packed delta-of-delta: 0..MaxPackedWidth, or 64
+    };
+
+    static quint64 zigzag(qint64 v) { return (quint64(v) << 1) ^ quint64(v >> 63); }
+    static qint64 unzigzag(quint64 z) { return qint64(z >> 1) ^ -qint64(z & 1); }
+    void pack(); // moves the full open chunk into bytes
+    void decode(size_t c, size_t m, qint64 *out) const; // the first m+1 values of chunk c
+
+    size_t n;
+    qint64 lastValue, lastDelta;
+    size_t streamLen;
+    std::vector<quint8> bytes;  // kept padded with 8 zero bytes so the decoder may load whole words
+    std::vector<Skip> skips;
+    std::vector<quint64> open;  // zigzagged delta-of-deltas of the last chunk while it is incomplete
+};
+
+#endif // TIMECOLUMN_H
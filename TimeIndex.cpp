@@ -0,0 +1,79 @@
+#include "TimeIndex.h"
+#include <algorithm>
+#include <utility>
+
+bool TimeIndex::find(qint64 t, unsigned *height) const
+{
+    auto p = pending.constFind(t);
+    if (p != pending.constEnd()) {
+        if (height) *height = *p;
+        return true;
+    }
+    if (ts.isEmpty() || t < ts.front() || t > ts.back()) return false; // the usual case while downloading
+    const size_t i = ts.indexOf(t);
+    if (i == ts.size()) return false;
+    if (height) *height = unsigned(hs.at(i));
+    return true;
+}
+
+bool TimeIndex::insert(qint64 t, unsigned height, unsigned *oldHeight)
+{
+    if (pending.isEmpty() && (ts.isEmpty() || t > ts.back())) { // a new tip
+        ts.append(t);
+        hs.append(height);
+        ++n;
+        return true;
+    }
+    const bool known = find(t, oldHeight);
+    if (!known) ++n;
+    pending.insert(t, height);
+    if (size_t(pending.size()) > std::max(size_t(MinPending), ts.size() / MergeRatio))
+        merge();
+    return !known;
+}
+
+void TimeIndex::clear()
+{
+    ts.clear();
+    hs.clear();
+    pending.clear();
+    n = 0;
+}
+
+void TimeIndex::merge() const
+{
+    if (pending.isEmpty()) return;
+    auto p = pending.constBegin();
+    if (!ts.isEmpty() && p.key() > ts.back()) { // all newer: no need to re-encode what is there
+        for (; p != pending.constEnd(); ++p) {
+            ts.append(p.key());
+            hs.append(*p);
+        }
+        pending.clear();
+        return;
+    }
+    TimeColumn t2, h2;
+    qint64 tb[TimeColumn::ChunkSize], hb[TimeColumn::ChunkSize];
+    for (size_t c = 0; c < ts.chunkCount(); ++c) {
+        const size_t cnt = ts.decodeChunk(c, tb);
+        hs.decodeChunk(c, hb);
+        for (size_t i = 0; i < cnt; ++i) {
+            for (; p != pending.constEnd() && p.key() < tb[i]; ++p) {
+                t2.append(p.key());
+                h2.append(*p);
+            }
+            t2.append(tb[i]);
+            if (p != pending.constEnd() && p.key() == tb[i]) h2.append(*p++);
+            else h2.append(hb[i]);
+        }
+    }
+    for (; p != pending.constEnd(); ++p) {
+        t2.append(p.key());
+        h2.append(*p);
+    }
+    t2.squeeze();
+    h2.squeeze();
+    ts = std::move(t2);
+    hs = std::move(h2);
+    pending.clear();
+}
@@ -0,0 +1,61 @@
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include "TimeColumn.h"
+#include <QMap>
+
+/// The distinct block timestamps in ascending order, each with the height of the block stored
+/// for it (see BlockStore::byTime()).
+///
+/// Times and heights are held in two parallel TimeColumns; heights taken in time order are
+/// nearly consecutive and pack to a few bits each. A time newer than all others is appended
+/// straight to the columns. Others collect in a small map that is merged into the columns
+/// once it holds more than 1/MergeRatio of them, so the map never holds more than a fraction
+/// of the history. times() and heights() merge first, so like the store itself the index must
+/// only be used from one thread at a time.
+class TimeIndex
+{
+public:
+    TimeIndex() : n(0) {}
+
+    int size() const { return n; }
+    bool isEmpty() const { return !n; }
+    bool contains(qint64 t) const { return find(t, nullptr); }
+    /// Whether t is indexed; if so and height is not null, sets *height to its block's height.
+    bool find(qint64 t, unsigned *height) const;
+    /// Adds t, or moves it to another height. Returns false if t was indexed already, and then
+    /// sets *oldHeight (if not null) to the height it had.
+    bool insert(qint64 t, unsigned height, unsigned *oldHeight = nullptr);
+    void clear();
+
+    const TimeColumn & times() const { merge(); return ts; }
+    const TimeColumn & heights() const { merge(); return hs; } // heights().at(i) goes with times().at(i)
+    /// Calls f(time, height) for each indexed time in [from, to), in order.
+    template <typename F> void scan(qint64 from, qint64 to, F && f) const;
+
+private:
+    enum { MinPending = 4096, MergeRatio = 16 };
+    void merge() const;
+
+    mutable TimeColumn ts, hs;
+    mutable QMap<qint64, unsigned> pending; // not yet merged; takes precedence over the columns
+    int n;
+};
+
+template <typename F> void TimeIndex::scan(qint64 from, qint64 to, F && f) const
+{
+    const TimeColumn & t = times();
+    qint64 tb[TimeColumn::ChunkSize], hb[TimeColumn::ChunkSize];
+    size_t i = t.lowerBound(from);
+    while (i < t.size()) {
+        const size_t c = i / TimeColumn::ChunkSize, cnt = t.decodeChunk(c, tb);
+        hs.decodeChunk(c, hb);
+        for (size_t j = i % TimeColumn::ChunkSize; j < cnt; ++j) {
+            if (tb[j] >= to) return;
+            f(tb[j], unsigned(hb[j]));
+        }
+        i = (c + 1) * TimeColumn::ChunkSize;
+    }
+}
+
+#endif // TIMEINDEX_H
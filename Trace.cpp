@@ -0,0 +1,166 @@
+#include "Trace.h"
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <cstdlib>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace Trace
+{
+    std::atomic<bool> on(false);
+
+    namespace {
+        struct Event
+        {
+            const char *name;
+            char ph;     // 'X' complete, 'b'/'e' async begin/end
+            qint64 ts;   // ns
+            qint64 dur;  // ns, for 'X'
+            quint64 id;  // for async events
+            qint64 arg;  // optional integer argument, -1 = none
+        };
+
+        // Only its own thread appends, but save() may read it from another thread (e.g. atexit
+        // while workers are still busy), so both sides take mut; it is practically never contended.
+        struct ThreadBuf
+        {
+            QMutex mut;
+            int tid;
+            QByteArray name;
+            bool stopped = false; // saved at exit, later events are dropped
+            std::vector<Event> events;
+        };
+
+        struct Registry
+        {
+            QMutex mut;
+            std::vector<std::unique_ptr<ThreadBuf>> bufs;
+            QString outFile;
+        };
+        // never destroyed: threads still running after exit() may trace into their buffers
+        Registry & registry() { static Registry *r = new Registry; return *r; }
+
+        ThreadBuf & threadBuf()
+        {
+            static thread_local ThreadBuf *buf = nullptr;
+            if (Q_UNLIKELY(!buf)) {
+                Registry & r = registry();
+                QMutexLocker l(&r.mut);
+                r.bufs.emplace_back(new ThreadBuf);
+                buf = r.bufs.back().get();
+                buf->tid = int(r.bufs.size());
+                buf->events.reserve(4096);
+            }
+            return *buf;
+        }
+
+        void push(const char *name, char ph, qint64 ts, qint64 dur, quint64 id, qint64 arg)
+        {
+            Event e;
+            e.name = name; e.ph = ph; e.ts = ts; e.dur = dur; e.id = id; e.arg = arg;
+            ThreadBuf & b = threadBuf();
+            QMutexLocker l(&b.mut);
+            if (!b.stopped) b.events.push_back(e);
+        }
+
+        void saveAtExit()
+        {
+            on = false;
+            Registry & r = registry();
+            {
+                QMutexLocker l(&r.mut);
+                for (const auto & b : r.bufs) {
+                    QMutexLocker bl(&b->mut);
+                    b->stopped = true;
+                }
+            }
+            const QString f = r.outFile;
+            if (!f.isEmpty()) save(f);
+        }
+
+        void appendUs(QByteArray & out, qint64 ns)
+        {
+            out += QByteArray::number(ns / 1000);
+            out += '.';
+            out += QByteArray::number(ns % 1000).rightJustified(3, '0');
+        }
+    }
+
+    void start(const QString & fileName)
+    {
+        registry().outFile = fileName;
+        if (!on) std::atexit(saveAtExit);
+        on = true;
+    }
+
+    void complete(const char *name, qint64 startNs, qint64 endNs)
+    {
+        push(name, 'X', startNs, endNs - startNs, 0, -1);
+    }
+
+    void asyncBegin(const char *name, quint64 id, qint64 arg)
+    {
+        push(name, 'b', Perf::nowNs(), 0, id, arg);
+    }
+
+    void asyncEnd(const char *name, quint64 id)
+    {
+        push(name, 'e', Perf::nowNs(), 0, id, -1);
+    }
+
+    void setThreadName(const char *name)
+    {
+        if (!on) return;
+        ThreadBuf & b = threadBuf();
+        QMutexLocker l(&b.mut);
+        b.name = name; // copied: thread names need not outlive their thread
+    }
+
+    bool save(const QString & fileName)
+    {
+        Registry & r = registry();
+        QMutexLocker l(&r.mut);
+        QFile f(fileName);
+        if (!f.open(QIODevice::WriteOnly|QIODevice::Truncate)) return false;
+        const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+        QByteArray out;
+        out.reserve(1 << 20);
+        out += "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        for (const auto & b : r.bufs) {
+            QMutexLocker bl(&b->mut);
+            const QByteArray tid = QByteArray::number(b->tid);
+            if (!b->name.isEmpty()) {
+                out += first ? "" : ",\n";
+                out += "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":\"" + b->name + "\"}}";
+                first = false;
+            }
+            for (const Event & e : b->events) {
+                out += first ? "{\"name\":\"" : ",\n{\"name\":\"";
+                first = false;
+                out += e.name;
+                out += "\",\"cat\":\"bcg\",\"ph\":\"";
+                out += e.ph;
+                out += "\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"ts\":";
+                appendUs(out, e.ts);
+                if (e.ph == 'X') {
+                    out += ",\"dur\":";
+                    appendUs(out, e.dur);
+                } else {
+                    out += ",\"id\":\"0x" + QByteArray::number(e.id, 16) + "\"";
+                }
+                if (e.arg >= 0) out += ",\"args\":{\"n\":" + QByteArray::number(e.arg) + "}";
+                out += '}';
+                if (out.size() > (1 << 20)) {
+                    f.write(out);
+                    out.clear();
+                }
+            }
+        }
+        out += "\n]}\n";
+        return f.write(out) == out.size() && f.flush();
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QtGlobal>
+#include <QString>
+#include <atomic>
+
+namespace Perf { qint64 nowNs(); }
+
+/// Chrome trace-event recorder (chrome://tracing, Perfetto).
+///
+/// Events go into a per-thread buffer behind its own (uncontended) lock and are written
+/// out as trace-event JSON when the process exits; events from threads still running
+/// after that are dropped. While disabled every hook is a single branch on a global
+/// flag; defining BCG_NO_TRACE compiles them out entirely.
+/// Event names must be string literals (only the pointer is stored).
+namespace Trace
+{
+    extern std::atomic<bool> on;
+    inline bool enabled() { return on.load(std::memory_order_relaxed); }
+
+    /// Enables recording; the trace is written to fileName at exit (including via Fatal).
+    void start(const QString & fileName);
+    bool save(const QString & fileName);
+
+    void complete(const char *name, qint64 startNs, qint64 endNs);
+    void asyncBegin(const char *name, quint64 id, qint64 arg = -1);
+    void asyncEnd(const char *name, quint64 id);
+    void setThreadName(const char *name);
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *n) : name(n), t0(enabled() ? Perf::nowNs() : -1) {}
+        ~Scope() { if (t0 >= 0) complete(name, t0, Perf::nowNs()); }
+    private:
+        Q_DISABLE_COPY(Scope)
+        const char * const name;
+        const qint64 t0;
+    };
+}
+
+#define TRACE_CAT2(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT2(a, b)
+#ifdef BCG_NO_TRACE
+#  define TRACE_SCOPE(name) (void)0
+#  define TRACE_ASYNC_BEGIN(name, id, arg) (void)0
+#  define TRACE_ASYNC_END(name, id) (void)0
+#else
+#  define TRACE_SCOPE(name) Trace::Scope TRACE_CAT(traceScope_, __LINE__)(name)
+#  define TRACE_ASYNC_BEGIN(name, id, arg) do { if (Trace::enabled()) Trace::asyncBegin(name, quint64(id), arg); } while (0)
+#  define TRACE_ASYNC_END(name, id) do { if (Trace::enabled()) Trace::asyncEnd(name, quint64(id)); } while (0)
+#endif
+
+#endif // TRACE_H
@@ -0,0 +1,130 @@
+#include "WaveletTree.h"
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+void WaveletTree::BitVector::init(size_t nbits)
+{
+    words.assign((nbits >> 6) + 1, 0);
+    ranks.clear();
+    nZeros = 0;
+}
+
+void WaveletTree::BitVector::finalize()
+{
+    ranks.resize(words.size());
+    quint32 acc = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        ranks[i] = acc;
+        acc += quint32(qPopulationCount(words[i]));
+    }
+}
+
+size_t WaveletTree::BitVector::rank1(size_t i) const
+{
+    const size_t w = i >> 6, b = i & 63;
+    size_t r = ranks[w];
+    if (b) r += size_t(qPopulationCount(words[w] & ((quint64(1) << b) - 1)));
+    return r;
+}
+
+void WaveletTree::clear()
+{
+    n = 0;
+    nBits = 0;
+    alphabet.clear();
+    levels.clear();
+}
+
+void WaveletTree::build(const std::vector<qint64> & values)
+{
+    std::vector<qint64> a = values;
+    std::sort(a.begin(), a.end());
+    a.erase(std::unique(a.begin(), a.end()), a.end());
+    std::vector<quint32> symbols(values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+        symbols[i] = quint32(std::lower_bound(a.begin(), a.end(), values[i]) - a.begin());
+    build(std::move(a), std::move(symbols));
+}
+
+void WaveletTree::build(std::vector<qint64> && a, std::vector<quint32> && symbols)
+{
+    clear();
+    n = symbols.size();
+    if (!n) return;
+
+    alphabet = std::move(a);
+    nBits = 1;
+    while ((size_t(1) << nBits) < alphabet.size()) ++nBits;
+
+    std::vector<quint32> cur = std::move(symbols), next(n);
+
+    // wavelet matrix: at each level (most significant bit first) stably partition zeros before ones
+    levels.resize(size_t(nBits));
+    for (int lv = 0; lv < nBits; ++lv) {
+        const int bit = nBits - 1 - lv;
+        BitVector & bv = levels[size_t(lv)];
+        bv.init(n);
+        size_t z = 0;
+        for (size_t i = 0; i < n; ++i)
+            if (!((cur[i] >> bit) & 1)) next[z++] = cur[i];
+        bv.nZeros = z;
+        size_t o = z;
+        for (size_t i = 0; i < n; ++i)
+            if ((cur[i] >> bit) & 1) { bv.set(i); next[o++] = cur[i]; }
+        bv.finalize();
+        cur.swap(next);
+    }
+}
+
+qint64 WaveletTree::kthSmallest(size_t l, size_t r, size_t k) const
+{
+    quint32 sym = 0;
+    for (int lv = 0; lv < nBits; ++lv) {
+        const BitVector & bv = levels[size_t(lv)];
+        const size_t l0 = bv.rank0(l), r0 = bv.rank0(r), zeros = r0 - l0;
+        sym <<= 1;
+        if (k < zeros) {
+            l = l0; r = r0;
+        } else {
+            k -= zeros;
+            sym |= 1;
+            l = bv.nZeros + (l - l0);
+            r = bv.nZeros + (r - r0);
+        }
+    }
+    return alphabet[sym];
+}
+
+size_t WaveletTree::countLess(size_t l, size_t r, qint64 x) const
+{
+    if (l >= r) return 0;
+    const size_t c = size_t(std::lower_bound(alphabet.begin(), alphabet.end(), x) - alphabet.begin());
+    if (c >= alphabet.size()) return r - l;
+    size_t ret = 0;
+    for (int lv = 0; lv < nBits; ++lv) {
+        const BitVector & bv = levels[size_t(lv)];
+        const size_t l0 = bv.rank0(l), r0 = bv.rank0(r);
+        if ((c >> (nBits - 1 - lv)) & 1) {
+            ret += r0 - l0;
+            l = bv.nZeros + (l - l0);
+            r = bv.nZeros + (r - r0);
+        } else {
+            l = l0; r = r0;
+        }
+    }
+    return ret;
+}
+
+qint64 WaveletTree::quantile(size_t l, size_t r, double q) const
+{
+    r = std::min(r, n);
+    if (l >= r) return -1;
+    const size_t cnt = r - l;
+    // nearest-rank: the ceil(q*cnt)-th smallest value
+    size_t k = q <= 0. ? 0 : size_t(std::ceil(q * double(cnt)));
+    if (k > 0) --k;
+    if (k >= cnt) k = cnt - 1;
+    return kthSmallest(l, r, k);
+}
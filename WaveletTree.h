@@ -0,0 +1,54 @@
+#ifndef WAVELETTREE_H
+#define WAVELETTREE_H
+
+#include <QtGlobal>
+#include <vector>
+
+/// Static wavelet tree (wavelet matrix layout) over a sequence of qint64 values.
+/// Built once in O(n log sigma), after which order statistics on any [l, r)
+/// index range are answered in O(log sigma) without copying or sorting the range.
+class WaveletTree
+{
+public:
+    WaveletTree() : n(0), nBits(0) {}
+    explicit WaveletTree(const std::vector<qint64> & values) { build(values); }
+
+    void build(const std::vector<qint64> & values);
+    /// The same, for values already given as indices into alphabet (sorted, distinct), which
+    /// saves holding the values themselves. symbols is used as scratch space.
+    void build(std::vector<qint64> && alphabet, std::vector<quint32> && symbols);
+    void clear();
+
+    size_t size() const { return n; }
+    bool isEmpty() const { return n == 0; }
+
+    /// k-th smallest (0-based) value in [l, r). Requires l <= k+l < r <= size().
+    qint64 kthSmallest(size_t l, size_t r, size_t k) const;
+    /// Number of values in [l, r) strictly less than x.
+    size_t countLess(size_t l, size_t r, qint64 x) const;
+    /// Nearest-rank quantile q in [0,1] of the values in [l, r). Returns -1 for an empty range.
+    qint64 quantile(size_t l, size_t r, double q) const;
+
+private:
+    /// Bit vector with constant-time rank support (one cumulative count per 64-bit word).
+    struct BitVector
+    {
+        std::vector<quint64> words;
+        std::vector<quint32> ranks; // number of set bits before words[i]
+        size_t nZeros = 0;
+
+        void init(size_t nbits);
+        void set(size_t i) { words[i >> 6] |= quint64(1) << (i & 63); }
+        bool get(size_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+        void finalize();
+        size_t rank1(size_t i) const; // set bits in [0, i)
+        size_t rank0(size_t i) const { return i - rank1(i); }
+    };
+
+    size_t n;
+    int nBits;
+    std::vector<qint64> alphabet; // sorted distinct values; the tree stores indices into this
+    std::vector<BitVector> levels;
+};
+
+#endif // WAVELETTREE_H
@@ -0,0 +1,258 @@
+#include "ParseCheck.h"
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include "Log.h"
+#include "Arena.h"
+#include "Block.h"
+#include "BlockParser.h"
+
+namespace ParseCheck
+{
+    namespace {
+        const char Valid[] = // a page with a bit of everything, whose truncations are checked too
+            "{\"bitcoin\":true, \"blocks\" : [\n"
+            " {\"hash\":\"00a\\u0062\\\"c\\\\\\/\\ud83d\\ude00\\n\",\"height\":100,\"time\":1500000000,\"main_chain\":true,\"x\":[1.5e3,-0,null,{}]},\n"
+            " {\"hash\":\"caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x98\x80\",\"height\":101,\"time\":1500000600,\"main_chain\":false},\n"
+            " {\"h\\u0065ight\":102,\"time\":1500001200,\"main_chain\":true,\"hash\":\"\"}\n"
+            "], \"n\":12345678901234567890}";
+
+        const char * const Cases[] = {
+            // escapes and surrogates
+            R"({"blocks":[{"hash":"a\"b\\c\/d\b\f\n\r\t","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"\u0041\u00e9\u20AC\u0000\uffff","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"\ud83d\ude00 \uD83D\uDE00","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"x\ud83dy","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"x\ude00","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"\ud83dA","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"\ud83d","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"\ude00\ud83d","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"h\u0065ight":7,"time":2,"main_chain":true,"hash":"e"}]})",
+            R"({"bl\u006fcks":[{"height":7,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"x\ud83d":"\ud83d"}]})",
+            // duplicate keys: the last one wins
+            R"({"blocks":[{"height":1,"height":2,"time":3,"time":4,"hash":"a","hash":"b","main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"main_chain":false}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":false,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"height":"x"}]})",
+            R"({"blocks":[{"height":"x","time":2,"main_chain":true,"height":1}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"hash":"a","hash":5}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true}],"blocks":[{"height":3,"time":4,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true}],"blocks":5})",
+            R"({"blocks":5,"blocks":[{"height":3,"time":4,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true}],"blocks":[]})",
+            // elements and fields that aren't what a page should have
+            R"({"blocks":[1]})",
+            R"({"blocks":["x"]})",
+            R"({"blocks":[null]})",
+            R"({"blocks":[true]})",
+            R"({"blocks":[[]]})",
+            R"({"blocks":[{}]})",
+            R"({"blocks":[{"a":1}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true},1]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":false},{}]})",
+            R"({"blocks":[]})",
+            R"({"blocks":{}})",
+            R"({"blocks":null})",
+            R"({})",
+            R"({"other":[{"height":1,"time":2,"main_chain":true}]})",
+            R"([])",
+            R"([{"blocks":[{"height":1,"time":2,"main_chain":true}]}])",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":"true"}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":1}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":null}]})",
+            R"({"blocks":[{"height":1,"time":2}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"hash":123}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"hash":null}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"hash":{"a":"b"}}]})",
+            R"({"blocks":[{"height":"1","time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":null,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":[2],"main_chain":true}]})",
+            R"({"blocks":[{"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"main_chain":true}]})",
+            R"({"blocks":[{"height":-1,"time":2,"main_chain":true}]})",
+            // numbers
+            R"({"blocks":[{"height":-0,"time":-0.0,"main_chain":true}]})",
+            R"({"blocks":[{"height":1.5,"time":2.999,"main_chain":true}]})",
+            R"({"blocks":[{"height":1e3,"time":1E+2,"main_chain":true}]})",
+            R"({"blocks":[{"height":25e-1,"time":-15e-1,"main_chain":true}]})",
+            R"({"blocks":[{"height":4294967295,"time":123456789012345678,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":1234567890123456789,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":-1234567890123456789,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":9007199254740993,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"n":123456789012345678901234567890}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"n":[1e308,-1e308,5e-324,1e-400]}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"n":1e999}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,"n":-1e999}]})",
+            R"({"blocks":[{"height":01,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":1.,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":.5,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":-,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":+1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":1e,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":1e+,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":--1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":0x10,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":NaN,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":Infinity,"time":2,"main_chain":true}]})",
+            // whitespace, and JSON that is malformed (or that only some parsers let through)
+            " \t\r\n{ \"blocks\" : [ { \"height\" : 1 , \"time\" : 2 , \"main_chain\" : true } ] } \r\n\t ",
+            "",
+            " ",
+            "null",
+            "true",
+            "1",
+            "\"blocks\"",
+            "{",
+            "{\"blocks\"",
+            "{\"blocks\":",
+            "{\"blocks\":[",
+            "{\"blocks\":[{",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true,}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true},]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true}],})",
+            R"({"blocks":[{"height" 1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{height:1,"time":2,"main_chain":true}]})",
+            R"({'blocks':[{"height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":1 "time":2,"main_chain":true}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":tru}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":True}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":nul}]})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true}]}x)",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true}]}{})",
+            R"({"blocks":[{"height":1,"time":2,"main_chain":true}]}])",
+            "\xef\xbb\xbf{\"blocks\":[{\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"a\tb\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"a\nb\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"a\x7f" "b\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            R"({"blocks":[{"hash":"a\qb","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"a\x41","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"a\u12","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"a\u12g4","height":1,"time":2,"main_chain":true}]})",
+            R"({"blocks":[{"hash":"a\","height":1,"time":2,"main_chain":true}]})",
+            "{\"blocks\":[{\"hash\":\"\xff\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"\x80\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"\xc0\xaf\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"\xe0\x80\xaf\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"\xed\xa0\x80\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"\xf4\x90\x80\x80\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"\xef\xbf\xbf\xf4\x8f\xbf\xbf\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"\xe2\x82\",\"height\":1,\"time\":2,\"main_chain\":true}]}",
+            "{\"blocks\":[{\"hash\":\"ok\",\"height\":1,\"time\":2,\"main_chain\":true,\"x\":\"\xfe\"}]}",
+            "{\"bl\xc3\xb6" "cks\":[],\"blocks\":[{\"height\":1,\"time\":2,\"main_chain\":true}]}",
+        };
+
+        // non-ASCII and control bytes as \xNN, so any page can go in the log
+        QString printable(const QByteArray & page)
+        {
+            static const int MaxShown = 160;
+            QString s;
+            for (int i = 0; i < page.size() && i < MaxShown; ++i) {
+                const unsigned char c = static_cast<unsigned char>(page[i]);
+                s += c >= 0x20 && c < 0x7f ? QString(QChar(c)) : QString().sprintf("\\x%02x", c);
+            }
+            if (page.size() > MaxShown) s += QString("... (%1 bytes)").arg(page.size());
+            return s;
+        }
+
+        QString describe(bool ok, const BlockList & bl, const QString & err)
+        {
+            return ok ? QString("%1 block(s)").arg(bl.size()) : QString("error \"%1\"").arg(err);
+        }
+
+        // What differs between the two parsers on page, or empty if nothing does.
+        QString compare(const QByteArray & page, Arena & arena)
+        {
+            QJsonParseError pe;
+            const QJsonDocument d = QJsonDocument::fromJson(page, &pe);
+            BlockList want, got;
+            QString wantErr, gotErr;
+            const bool wantOk = BlockParser::parseJson(d, want, &wantErr);
+            if (pe.error != QJsonParseError::NoError)
+                wantErr = QString("error parsing JSON: %1 at offset %2").arg(pe.errorString()).arg(pe.offset);
+            const bool gotOk = BlockParser::parsePage(page, arena, got, &gotErr);
+            arena.reset();
+            if (wantOk != gotOk || (!gotOk && wantErr != gotErr))
+                return QString("parseJson gave %1, parsePage %2").arg(describe(wantOk, want, wantErr)).arg(describe(gotOk, got, gotErr));
+            if (!gotOk) return QString();
+            if (want.size() != got.size())
+                return QString("parseJson gave %1 block(s), parsePage %2").arg(want.size()).arg(got.size());
+            for (int i = 0; i < want.size(); ++i) {
+                const Block & w = want[i], & g = got[i];
+                if (w.height != g.height || w.time != g.time || w.hash != g.hash)
+                    return QString("block %1: parseJson gave height %2 time %3 hash \"%4\", parsePage height %5 time %6 hash \"%7\"")
+                        .arg(i).arg(w.height).arg(w.time).arg(printable(w.hash.toUtf8()))
+                        .arg(g.height).arg(g.time).arg(printable(g.hash.toUtf8()));
+            }
+            return QString();
+        }
+
+        int check(const QByteArray & page, const QString & what, Arena & arena)
+        {
+            const QString diff = compare(page, arena);
+            if (diff.isEmpty()) return 0;
+            Log() << what << ": " << diff << "\n    page: " << printable(page);
+            return 1;
+        }
+    }
+
+    int pages(const std::vector<QByteArray> & pages, const QString & what)
+    {
+        Arena arena;
+        int bad = 0;
+        for (size_t i = 0; i < pages.size(); ++i)
+            bad += check(pages[i], QString("%1 page %2").arg(what).arg(i), arena);
+        return bad;
+    }
+
+    int edgeCases()
+    {
+        Arena arena;
+        int bad = 0, n = 0;
+        for (const char *c : Cases)
+            bad += check(QByteArray(c), QString("edge case %1").arg(n++), arena);
+
+        // NUL bytes, which the string literals above can't hold
+        static const char NulInString[] = "{\"blocks\":[{\"hash\":\"a\0b\",\"height\":1,\"time\":2,\"main_chain\":true}]}";
+        static const char NulAfter[] = "{\"blocks\":[]}\0";
+        bad += check(QByteArray(NulInString, int(sizeof(NulInString)) - 1), "NUL in a string", arena);
+        bad += check(QByteArray(NulAfter, int(sizeof(NulAfter)) - 1), "NUL after the document", arena);
+
+        // nesting around the 1024-level limit, inside a block and at the top
+        for (int levels = 1020; levels <= 1028; ++levels) {
+            const QByteArray inner = QByteArray(levels - 3, '[') + QByteArray(levels - 3, ']');
+            bad += check("{\"blocks\":[{\"height\":1,\"time\":2,\"main_chain\":true,\"x\":" + inner + "}]}",
+                         QString("%1 levels in a block").arg(levels), arena);
+            bad += check("{\"a\":" + QByteArray(levels - 1, '[') + QByteArray(levels - 1, ']') + "}",
+                         QString("%1 levels").arg(levels), arena);
+        }
+
+        // every truncation of a valid page, and the page with each byte replaced by something awkward
+        const QByteArray valid(Valid);
+        for (int len = 0; len < valid.size(); ++len)
+            bad += check(valid.left(len), QString("valid page cut at %1").arg(len), arena);
+        bad += check(valid, "valid page", arena);
+        static const char Awkward[] = { '"', '\\', ',', ':', '}', ']', ' ', '\0', '\x80', '\xff' };
+        for (int i = 0; i < valid.size(); ++i)
+            for (char c : Awkward) {
+                QByteArray p = valid;
+                p[i] = c;
+                bad += check(p, QString("valid page with byte %1 replaced by \\x%2").arg(i).arg(uint(uchar(c)), 2, 16, QChar('0')), arena);
+            }
+        return bad;
+    }
+
+    int directory(const QString & dirName)
+    {
+        const QDir dir(dirName);
+        if (!dir.exists()) Fatal("No such directory: %s", dirName.toUtf8().constData());
+        Arena arena;
+        int bad = 0;
+        for (const QString & name : dir.entryList(QStringList("*.json"), QDir::Files, QDir::Name)) {
+            QFile f(dir.filePath(name));
+            if (!f.open(QIODevice::ReadOnly)) Fatal("Could not open %s", f.fileName().toUtf8().constData());
+            bad += check(f.readAll(), f.fileName(), arena);
+        }
+        return bad;
+    }
+}
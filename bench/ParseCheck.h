@@ -0,0 +1,23 @@
+#ifndef PARSECHECK_H
+#define PARSECHECK_H
+
+#include <QByteArray>
+#include <QString>
+#include <vector>
+
+/// Differential check of BlockParser::parsePage against parseJson(QJsonDocument::fromJson()):
+/// both must accept the same pages and produce the same blocks (height, hash and time, in
+/// order), and reject the others with the same error -- except where fromJson itself fails,
+/// for which parsePage reports "error parsing JSON: <the QJsonParseError> at offset N".
+/// Differences are logged; the functions return how many pages differed.
+namespace ParseCheck
+{
+    int pages(const std::vector<QByteArray> & pages, const QString & what);
+    /// Hand-written edge cases (escapes, surrogates, duplicate keys, odd elements and numbers)
+    /// and malformed pages, plus every truncation of a valid page.
+    int edgeCases();
+    /// Every *.json page in dir, such as pages saved with --record or chaingen --out-json.
+    int directory(const QString & dir);
+}
+
+#endif // PARSECHECK_H
@@ -0,0 +1,43 @@
+# Microbenchmarks for the parse, ingest, stats and CSV export paths
+
+TEMPLATE = app
+TARGET = bench
+INCLUDEPATH += ..
+include(../common.pri)
+QT += concurrent # the QtConcurrent baselines for the TaskPool benchmarks
+DEFINES += BCG_ALLOC_TRACK # allocation counts are part of every result
+
+HEADERS += ParseCheck.h \
+           ../Log.h \
+           ../AllocTrack.h \
+           ../Block.h \
+           ../BlockFile.h \
+           ../Arena.h \
+           ../BlockParser.h \
+           ../BlockStore.h \
+           ../ChainGen.h \
+           ../Csv.h \
+           ../Stats.h \
+           ../TaskPool.h \
+           ../Perf.h \
+           ../Trace.h \
+           ../TimeColumn.h \
+           ../TimeIndex.h \
+           ../WaveletTree.h
+SOURCES += main.cpp \
+           ParseCheck.cpp \
+           ../Log.cpp \
+           ../AllocTrack.cpp \
+           ../BlockFile.cpp \
+           ../Arena.cpp \
+           ../BlockParser.cpp \
+           ../BlockStore.cpp \
+           ../ChainGen.cpp \
+           ../Csv.cpp \
+           ../Stats.cpp \
+           ../TaskPool.cpp \
+           ../Perf.cpp \
+           ../Trace.cpp \
+           ../TimeColumn.cpp \
+           ../TimeIndex.cpp \
+           ../WaveletTree.cpp
@@ -0,0 +1,342 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QFile>
+#include <QIODevice>
+#include <QHash>
+#include <QPair>
+#include <QtConcurrent>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <memory>
+#include <vector>
+#include "Log.h"
+#include "AllocTrack.h"
+#include "Block.h"
+#include "BlockParser.h"
+#include "Arena.h"
+#include "BlockStore.h"
+#include "ChainGen.h"
+#include "Csv.h"
+#include "Stats.h"
+#include "TaskPool.h"
+#include "ParseCheck.h"
+
+namespace {
+    const int BlocksPerPage = 144; // about a day's worth, like the real pages
+    const size_t ReduceGrain = 4096;
+
+    void addTo(qint64 & acc, const qint64 & v) { acc += v; } // QtConcurrent reduce function
+
+    /// Discards everything written to it, so CSV benchmarks measure formatting only.
+    class NullDevice : public QIODevice
+    {
+    public:
+        NullDevice() { open(QIODevice::WriteOnly); }
+    protected:
+        qint64 readData(char *, qint64) override { return -1; }
+        qint64 writeData(const char *, qint64 len) override { return len; }
+    };
+
+    struct Result
+    {
+        QString name;
+        quint64 n = 0;
+        double nsPerBlock = 0., allocsPerBlock = 0., bytesPerBlock = 0.;
+        QString key() const { return QString("%1/%2").arg(name).arg(n); }
+    };
+
+    /// Runs body (with untimed setup/teardown around each rep) at least 3 times and for at least
+    /// minSecs, and reports the best rep. Allocations are counted over the first timed rep.
+    Result measure(const QString & name, quint64 n, double minSecs,
+                   const std::function<void()> & setup, const std::function<void()> & body,
+                   const std::function<void()> & teardown)
+    {
+        Result r;
+        r.name = name;
+        r.n = n;
+        qint64 best = -1, total = 0;
+        for (int rep = 0; rep < 3 || (total < qint64(minSecs*1e9) && rep < 1000); ++rep) {
+            if (setup) setup();
+            const AllocTrack::Counters a0 = AllocTrack::total();
+            QElapsedTimer t;
+            t.start();
+            body();
+            const qint64 el = t.nsecsElapsed();
+            if (!rep) {
+                const AllocTrack::Counters a1 = AllocTrack::total();
+                r.allocsPerBlock = double(a1.allocs - a0.allocs) / double(n);
+                r.bytesPerBlock = double(a1.bytes - a0.bytes) / double(n);
+            }
+            if (teardown) teardown();
+            total += el;
+            if (best < 0 || el < best) best = el;
+        }
+        r.nsPerBlock = double(best) / double(n);
+        return r;
+    }
+
+    QHash<QString, Result> loadBaseline(const QString & fileName)
+    {
+        QHash<QString, Result> ret;
+        QFile f(fileName);
+        if (!f.open(QIODevice::ReadOnly))
+            Fatal("Could not open baseline %s", fileName.toUtf8().constData());
+        for (const QJsonValue & v : QJsonDocument::fromJson(f.readAll()).object().value("results").toArray()) {
+            const QJsonObject o = v.toObject();
+            Result r;
+            r.name = o.value("name").toString();
+            r.n = quint64(o.value("n").toDouble());
+            r.nsPerBlock = o.value("ns_per_block").toDouble();
+            r.allocsPerBlock = o.value("allocs_per_block").toDouble();
+            r.bytesPerBlock = o.value("bytes_per_block").toDouble();
+            ret.insert(r.key(), r);
+        }
+        return ret;
+    }
+
+    /// JSON pages for a synthetic chain, BlocksPerPage records each.
+    std::vector<QByteArray> makePages(const ChainGen & gen)
+    {
+        std::vector<QByteArray> pages;
+        QByteArray page;
+        int inPage = 0;
+        gen.forEachRecord([&](const BlockFile::Record & r) {
+            ChainGen::appendJson(page, r);
+            if (++inPage == BlocksPerPage) {
+                pages.push_back("{\"blocks\":[" + page + "]}");
+                page.clear();
+                inPage = 0;
+            }
+        });
+        if (!page.isEmpty()) pages.push_back("{\"blocks\":[" + page + "]}");
+        return pages;
+    }
+
+    /// --check-parsers: parsePage against parseJson on everything ParseCheck has. Returns false on any difference.
+    bool checkParsers(const QString & corpusDir)
+    {
+        // a chain with everything the generator can do: skewed times, duplicates and orphans
+        ChainGen::Config c;
+        c.nBlocks = 20000;
+        c.seed = 7;
+        c.outOfOrderRate = 0.05;
+        c.duplicateRate = 0.02;
+        c.orphanRate = 0.05;
+        int bad = ParseCheck::pages(makePages(ChainGen(c)), "synthetic");
+        bad += ParseCheck::edgeCases();
+        if (!corpusDir.isEmpty()) bad += ParseCheck::directory(corpusDir);
+        if (bad) Log("parsePage and parseJson differ on %d page(s)", bad);
+        else Log("parsePage and parseJson agree");
+        return !bad;
+    }
+
+    void saveResults(const QString & fileName, const QList<Result> & results)
+    {
+        QJsonArray arr;
+        for (const Result & r : results) {
+            QJsonObject o;
+            o["name"] = r.name;
+            o["n"] = double(r.n);
+            o["ns_per_block"] = r.nsPerBlock;
+            o["allocs_per_block"] = r.allocsPerBlock;
+            o["bytes_per_block"] = r.bytesPerBlock;
+            arr.append(o);
+        }
+        QJsonObject root;
+        root["results"] = arr;
+        QFile f(fileName);
+        if (!f.open(QIODevice::WriteOnly|QIODevice::Truncate) || f.write(QJsonDocument(root).toJson()) < 0)
+            Fatal("Could not write %s", fileName.toUtf8().constData());
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Microbenchmarks for BlockChainGrok's parse, ingest, stats and CSV export paths.");
+    parser.addHelpOption();
+    QCommandLineOption sizesOpt("sizes", "Comma-separated block counts to benchmark.", "list", "1000,100000,10000000");
+    QCommandLineOption filterOpt("filter", "Only run benchmarks whose name contains <text>.", "text");
+    QCommandLineOption minTimeOpt("min-time", "Minimum seconds to spend on each benchmark.", "secs", "0.2");
+    QCommandLineOption saveOpt("save", "Save results as JSON to <file>, for use as a baseline.", "file");
+    QCommandLineOption baselineOpt("baseline", "Compare against results saved earlier with --save.", "file");
+    QCommandLineOption thresholdOpt("threshold", "With --baseline, exit with status 2 if any ns/block regresses by more than <pct> percent.", "pct");
+    QCommandLineOption checkOpt("check-parsers", "Instead of benchmarking, check that the arena parser gives the same blocks and errors as the QJsonDocument one, on synthetic, edge-case and malformed pages; exit with status 1 if not.");
+    QCommandLineOption corpusOpt("corpus", "With --check-parsers, also check every *.json page in <dir> (e.g. saved with --record).", "dir");
+    parser.addOptions({sizesOpt, filterOpt, minTimeOpt, saveOpt, baselineOpt, thresholdOpt, checkOpt, corpusOpt});
+    parser.process(app);
+    if (parser.isSet(checkOpt))
+        return checkParsers(parser.value(corpusOpt)) ? 0 : 1;
+    if (!AllocTrack::enabled())
+        Log("Allocation tracking is not available on this platform; allocs/blk and bytes/blk will read 0");
+
+    const QString filter = parser.value(filterOpt);
+    const double minSecs = parser.value(minTimeOpt).toDouble();
+    const QHash<QString, Result> baseline = parser.isSet(baselineOpt) ? loadBaseline(parser.value(baselineOpt)) : QHash<QString, Result>();
+    const double threshold = parser.isSet(thresholdOpt) ? parser.value(thresholdOpt).toDouble() : -1.;
+    bool regressed = false;
+    QList<Result> results;
+
+    Log("%-14s %10s %12s %12s %12s %12s %8s", "benchmark", "blocks", "ns/block", "allocs/blk", "bytes/blk", "base ns/blk", "diff");
+    auto report = [&](const Result & r) {
+        results.append(r);
+        QString base = "-", diff = "";
+        auto it = baseline.constFind(r.key());
+        if (it != baseline.constEnd() && it->nsPerBlock > 0.) {
+            const double pct = (r.nsPerBlock - it->nsPerBlock) / it->nsPerBlock * 100.;
+            base = QString::number(it->nsPerBlock, 'f', 2);
+            diff = QString().sprintf("%+.1f%%", pct);
+            if (threshold >= 0. && pct > threshold) regressed = true;
+        }
+        Log("%-14s %10llu %12.2f %12.2f %12.1f %12s %8s", r.name.toUtf8().constData(), r.n, r.nsPerBlock, r.allocsPerBlock,
+            r.bytesPerBlock, base.toUtf8().constData(), diff.toUtf8().constData());
+    };
+    auto run = [&](const char *name, quint64 n, const std::function<void()> & setup, const std::function<void()> & body,
+                   const std::function<void()> & teardown) {
+        if (filter.isEmpty() || QString(name).contains(filter))
+            report(measure(name, n, minSecs, setup, body, teardown));
+    };
+
+    for (const QString & s : parser.value(sizesOpt).split(',', QString::SkipEmptyParts)) {
+        const quint64 n = s.toULongLong();
+        if (!n) continue;
+
+        // synthetic inputs: the blocks themselves, and JSON pages for at most 100K of them
+        // (larger parse runs cycle through the same pages)
+        ChainGen::Config c;
+        c.nBlocks = n;
+        c.seed = 42;
+        ChainGen gen(c);
+        BlockList blocks;
+        blocks.reserve(int(n));
+        gen.forEachRecord([&](const BlockFile::Record & r) {
+            blocks.append(Block(r.height, QString::fromLatin1(BlockFile::hashHex(r)), r.time));
+        });
+        ChainGen::Config pc = c; // the same chain, cut short
+        pc.nBlocks = std::min(n, quint64(100000));
+        const std::vector<QByteArray> pages = makePages(ChainGen(pc));
+        // timing parsers that disagree would be pointless
+        if (ParseCheck::pages(pages, QString("%1-block").arg(n)))
+            Fatal("parsePage and parseJson differ on the benchmark pages");
+
+        BlockList parsed;
+        auto parseAll = [&](bool (*parse)(const QJsonDocument &, BlockList &, QString *)) {
+            for (quint64 done = 0; done < n; ) {
+                for (const QByteArray & p : pages) {
+                    const QJsonDocument d = QJsonDocument::fromJson(p);
+                    parsed.clear();
+                    if (parse) parse(d, parsed, nullptr);
+                    if ((done += BlocksPerPage) >= n) break;
+                }
+            }
+        };
+        run("json.fromJson", n, nullptr, [&]{ parseAll(nullptr); }, nullptr);
+        run("parse.variant", n, nullptr, [&]{ parseAll(&BlockParser::parseVariant); }, nullptr);
+        run("parse.json", n, nullptr, [&]{ parseAll(&BlockParser::parseJson); }, nullptr);
+        Arena arena;
+        run("parse.arena", n, nullptr, [&]{
+            for (quint64 done = 0; done < n; ) {
+                for (const QByteArray & p : pages) {
+                    parsed.clear();
+                    BlockParser::parsePage(p, arena, parsed, nullptr);
+                    arena.reset();
+                    if ((done += BlocksPerPage) >= n) break;
+                }
+            }
+        }, nullptr);
+
+        // the same pages parsed concurrently, on the work-stealing pool and on QtConcurrent
+        TaskPool & pool = TaskPool::global();
+        std::vector<size_t> pageIdx(size_t((n + BlocksPerPage - 1) / BlocksPerPage));
+        std::iota(pageIdx.begin(), pageIdx.end(), size_t(0));
+        auto parsePage = [&](size_t i) {
+            BlockList bl;
+            BlockParser::parseJson(QJsonDocument::fromJson(pages[i % pages.size()]), bl, nullptr);
+        };
+        run("parse.pool", n, nullptr, [&]{
+            parallelFor(pool, 0, pageIdx.size(), 1, [&](size_t lo, size_t hi) { for (size_t i = lo; i < hi; ++i) parsePage(i); });
+        }, nullptr);
+        run("parse.qtconc", n, nullptr, [&]{
+            QtConcurrent::blockingMap(pageIdx, [&](size_t & i) { parsePage(i); });
+        }, nullptr);
+
+        std::unique_ptr<BlockStore> store;
+        auto freshStore = [&]{
+            store.reset(new BlockStore);
+            store->setLogDupes(false);
+        };
+        run("ingest", n, freshStore, [&]{ store->ingest(blocks); store->byTime().times(); }, nullptr); // with the last merge of the time index
+        if (!store) { // filtered out above; the remaining benchmarks still need a populated store
+            freshStore();
+            store->ingest(blocks);
+        }
+
+        IntervalIndex index;
+        run("stats.index", n, nullptr, [&]{ index.build(store->byTime().times()); }, nullptr);
+        if (index.timeColumn().isEmpty()) index.build(store->byTime().times());
+        run("stats.loop", n, nullptr, [&]{
+            computeIntervalStats(index.timeColumn(), store->blockCount(), store->dupeTimes(), 7ll*60ll+30ll);
+        }, nullptr);
+        run("stats.pool", n, nullptr, [&]{
+            computeIntervalStats(index.timeColumn(), store->blockCount(), store->dupeTimes(), 7ll*60ll+30ll, pool);
+        }, nullptr);
+
+        // scheduling overhead alone: a sum over the timestamps in ReduceGrain pieces
+        const std::vector<qint64> flat = index.timeColumn().toVector();
+        std::function<qint64(const QPair<size_t, size_t> &)> sumRange = [&flat](const QPair<size_t, size_t> & r) {
+            return std::accumulate(flat.begin() + qint64(r.first), flat.begin() + qint64(r.second), qint64(0));
+        };
+        QVector<QPair<size_t, size_t>> ranges;
+        for (size_t lo = 0; lo < flat.size(); lo += ReduceGrain)
+            ranges.append(qMakePair(lo, std::min(flat.size(), lo + ReduceGrain)));
+        // the requirement for TimeColumn: a full decode about as fast as reading the raw array
+        qint64 sum = 0;
+        run("timecol.scan", n, nullptr, [&]{ index.timeColumn().scan([&sum](qint64 t) { sum += t; }); }, nullptr);
+        run("timecol.raw", n, nullptr, [&]{ sum += std::accumulate(flat.begin(), flat.end(), qint64(0)); }, nullptr);
+        if (results.size() >= 2 && results.last().name == "timecol.raw" && results[results.size()-2].name == "timecol.scan")
+            Log("timecol.scan takes %.2fx the time of timecol.raw (sum %lld)",
+                results[results.size()-2].nsPerBlock / results.last().nsPerBlock, sum);
+        run("reduce.pool", n, nullptr, [&]{
+            parallelReduce(pool, 0, flat.size(), ReduceGrain, qint64(0),
+                           [&](size_t lo, size_t hi) { return sumRange(qMakePair(lo, hi)); },
+                           [](qint64 a, qint64 b) { return a + b; });
+        }, nullptr);
+        run("reduce.qtconc", n, nullptr, [&]{
+            QtConcurrent::blockingMappedReduced<qint64>(ranges, sumRange, addTo);
+        }, nullptr);
+
+        // one query per 1000 blocks, over random time ranges, so that ns/block tracks the cost of
+        // a query (O(log sigma) plus two column lookups) like every other row tracks its work
+        std::vector<QPair<qint64, qint64>> queryRanges(size_t(std::max(n / 1000, quint64(1))));
+        std::mt19937_64 rng(42);
+        const qint64 first = index.timeColumn().front(), span = index.timeColumn().back() - first + 1;
+        for (QPair<qint64, qint64> & r : queryRanges) {
+            const qint64 a = first + qint64(rng() % quint64(span)), b = first + qint64(rng() % quint64(span));
+            r = qMakePair(std::min(a, b), std::max(a, b) + 1);
+        }
+        qint64 q = 0;
+        run("stats.quantile", n, nullptr, [&]{
+            for (size_t i = 0; i < queryRanges.size(); ++i)
+                q += index.quantile(queryRanges[i].first, queryRanges[i].second, i % 2 ? 0.99 : 0.5);
+        }, nullptr);
+        Q_UNUSED(q);
+
+        run("csv", n, nullptr, [&]{
+            NullDevice dev;
+            Csv::write(dev, store->byHeight(), Csv::HeightTimeHash);
+        }, nullptr);
+    }
+
+    if (parser.isSet(saveOpt)) saveResults(parser.value(saveOpt), results);
+    if (regressed) {
+        Log("Regression above %g%% threshold against baseline", threshold);
+        return 2;
+    }
+    return 0;
+}
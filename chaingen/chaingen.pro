@@ -0,0 +1,14 @@
+# Synthetic blockchain generator, see ChainGen.h
+
+TEMPLATE = app
+TARGET = chaingen
+INCLUDEPATH += ..
+include(../common.pri)
+
+HEADERS += ../Log.h \
+           ../BlockFile.h \
+           ../ChainGen.h
+SOURCES += main.cpp \
+           ../Log.cpp \
+           ../BlockFile.cpp \
+           ../ChainGen.cpp
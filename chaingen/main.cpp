@@ -0,0 +1,62 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include "Log.h"
+#include "ChainGen.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates a deterministic synthetic blockchain as a binary block store and/or blockchain.info-shaped JSON pages.");
+    parser.addHelpOption();
+    QCommandLineOption blocksOpt("blocks", "Number of blocks (heights) to generate.", "n", "1000000");
+    QCommandLineOption seedOpt("seed", "Random seed; the same seed always gives the same chain.", "seed", "1");
+    QCommandLineOption binOpt("out-bin", "Write a binary block store to <file>.", "file");
+    QCommandLineOption jsonOpt("out-json", "Write one <utc day>.json page per day to <dir> (servable with mockserver --record-dir).", "dir");
+    QCommandLineOption spacingOpt("spacing", "Mean block interval after a retarget, in seconds.", "secs", "600");
+    QCommandLineOption driftOpt("drift", "Hashrate growth per 2016-block retarget period (0.05 = 5%).", "frac", "0");
+    QCommandLineOption oooOpt("out-of-order", "Fraction of blocks with skewed (out of order) timestamps.", "frac", "0");
+    QCommandLineOption skewOpt("max-skew", "Maximum timestamp skew in seconds.", "secs", "7200");
+    QCommandLineOption dupOpt("duplicates", "Fraction of blocks listed twice.", "frac", "0");
+    QCommandLineOption orphanOpt("orphans", "Fraction of heights with an extra main_chain:false block.", "frac", "0");
+    QCommandLineOption genesisOpt("genesis-time", "Time of block 0, seconds since the epoch.", "secs", "1231006505");
+    QCommandLineOption threadsOpt("threads", "Worker threads (0 = one per core).", "n", "0");
+    parser.addOptions({blocksOpt, seedOpt, binOpt, jsonOpt, spacingOpt, driftOpt, oooOpt, skewOpt, dupOpt, orphanOpt, genesisOpt, threadsOpt});
+    parser.process(app);
+    if (!parser.isSet(binOpt) && !parser.isSet(jsonOpt)) {
+        Log("Please pass --out-bin and/or --out-json");
+        return 1;
+    }
+
+    ChainGen::Config c;
+    c.nBlocks = parser.value(blocksOpt).toULongLong();
+    c.seed = parser.value(seedOpt).toULongLong();
+    c.spacing = parser.value(spacingOpt).toDouble();
+    c.drift = parser.value(driftOpt).toDouble();
+    c.outOfOrderRate = parser.value(oooOpt).toDouble();
+    c.maxSkew = parser.value(skewOpt).toLongLong();
+    c.duplicateRate = parser.value(dupOpt).toDouble();
+    c.orphanRate = parser.value(orphanOpt).toDouble();
+    c.genesisTime = parser.value(genesisOpt).toLongLong();
+    c.threads = parser.value(threadsOpt).toInt();
+
+    QElapsedTimer t;
+    t.start();
+    ChainGen gen(c);
+    Log("Planned %llu records for %llu blocks on %d threads in %.3f s", gen.recordCount(), gen.config().nBlocks, gen.config().threads, t.nsecsElapsed()/1e9);
+    QString err;
+    if (parser.isSet(binOpt)) {
+        t.restart();
+        if (!gen.writeBinary(parser.value(binOpt), &err))
+            Fatal("Could not write %s: %s", parser.value(binOpt).toUtf8().constData(), err.toUtf8().constData());
+        Log("Wrote %s in %.3f s", parser.value(binOpt).toUtf8().constData(), t.nsecsElapsed()/1e9);
+    }
+    if (parser.isSet(jsonOpt)) {
+        t.restart();
+        if (!gen.writeJsonPages(parser.value(jsonOpt), &err))
+            Fatal("Could not write pages: %s", err.toUtf8().constData());
+        Log("Wrote JSON pages to %s in %.3f s", parser.value(jsonOpt).toUtf8().constData(), t.nsecsElapsed()/1e9);
+    }
+    return 0;
+}
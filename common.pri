@@ -0,0 +1,26 @@
+# Settings shared by BlockChainGrok and the helper programs in its subdirectories
+
+CONFIG += console c++11 core
+QT += network
+
+# qmake CONFIG+=alloc_track: count heap allocations per pipeline phase (see AllocTrack.h)
+alloc_track {
+    DEFINES += BCG_ALLOC_TRACK
+}
+
+# qmake CONFIG+=coroutines: the downloads are written as C++20 coroutines (see Coro.h)
+coroutines {
+    CONFIG -= c++11
+    CONFIG += c++2a
+    DEFINES += BCG_COROUTINES
+    *-g++*: QMAKE_CXXFLAGS += -fcoroutines # GCC 10 doesn't enable them by -std alone
+}
+
+macx {
+    CONFIG -= app_bundle
+    QMAKE_CXXFLAGS += -Wno-format-nonliteral -Wno-format -Wno-format-security
+}
+
+linux {
+    QMAKE_CXXFLAGS += -Wno-format-nonliteral -Wno-format -Wno-format-security
+}
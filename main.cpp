@@ -13,89 +13,152 @@
 #include <utility>
 #include <QTextStream>
 #include <exception>
-#include <QMultiMap>
+#include <QMap>
 #include <QFile>
+#include <QHash>
+#include <QSet>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <deque>
+#include "Log.h"
+#include "Block.h"
+#include "BlockParser.h"
+#include "BlockStore.h"
+#include "Stats.h"
+#include "Csv.h"
+#include "Perf.h"
+#include "MockServer.h"
+#include "Fetcher.h"
+#include "Checkpoint.h"
+#include "FetchPlanner.h"
+#include "QueryServer.h"
+#include "MetricsServer.h"
+#include "Notifier.h"
+#include "Pipeline.h"
+#include "TaskPool.h"
+#include "Coro.h"
+#include "Arena.h"
+#include "AllocTrack.h"
 
+namespace {
+    const qint64 StatsCutoff = 7ll*60ll+30ll; // 7.5 mins, for the Craig vs Peter R test
+    const int PipelineDepth = 4; // --threads: pages queued per parser thread
+}
 
-class Log : public QTextStream
+struct Options
 {
-public:
-    Log() { setString(&str, QIODevice::WriteOnly); }
-    template <typename ...T>
-    Log(const char *fmt,T&&...args) {
-        setString(&str, QIODevice::WriteOnly);
-        QString s = QString().sprintf(fmt,std::forward<T>(args)...);
-        (*this) << s;
-    }
-    virtual ~Log() { finishPrt(); }
-protected:
-    void finishPrt() {
-        flush();
-        setString(0);
-        if (str.isNull()) return;
-        QMutexLocker l(&mut);
-        if (str.isEmpty() || !str.endsWith("\n")) str += "\n";
-        std::cout << str.toUtf8().constData();
-        str = QString::null;
-    }
+    int ndays = 0;
+    QString perfJsonFile; // if set, per-phase timings are dumped here as JSON at exit
+    QString traceFile; // if set, a Chrome trace-event file is written here at exit
+    QString baseUrl = "https://blockchain.info";
+    QString recordDir; // if set, every downloaded page is saved here as <utc day>.json
+    Fetcher::Config fetch;
+    bool warmUp = true;       // resolve and connect while starting up
+    QString tlsSessionFile;   // if set, the TLS session is kept here for the next run
+    QString checkpointFile = "blocks.checkpoint";
+    int checkpointEvery = 25; // days ingested between checkpoints, 0 = never
+    bool resume = false;      // continue from checkpointFile
+    int watchSecs = 0;        // > 0: after the download, poll for new blocks this often instead of exiting
+    quint16 servePort = 0;    // > 0: after the download, answer queries on this port instead of exiting
+    QString serveAddress = "127.0.0.1";
+    int serveThreads = 0;     // 0 = one per core
+    QString notifySocket;     // if set, push new blocks and stats to subscribers on this local socket
+    int threads = 0;          // > 0: parse on this many threads and ingest on another (see Pipeline)
+    std::function<qint64()> clock = &QDateTime::currentMSecsSinceEpoch; // ms since the epoch
 
-private:
-    static QMutex mut;
-    QString str;
+    // --bench-e2e: the run is checked against these at exit; 0 = no limit
+    bool benchE2e = false;
+    std::function<qint64()> mockCpuNs; // CPU time of the in-process mock, which the CPU figure leaves out
+    double budgetWallSecs = 0., budgetCpuSecs = 0., budgetRssMiB = 0., budgetMinBlocksPerSec = 0.;
 };
 
-class Fatal : public Log
-{
-public:
-    Fatal() {}
-    template <typename ... T>
-    Fatal(const char *fmt, T&&...args) : Log(fmt, std::forward<T>(args)...) {}
-    ~Fatal() {
-        finishPrt();
-        std::exit(1); // exit immediately
-    }
-};
-
-/*static*/ QMutex Log::mut;
-
-
-struct Block
-{
-    Block() : height(0), time(0) {}
-    Block(unsigned h, const QString &hh, qint64 t) : height(h), hash(hh), time(t) {}
-    unsigned height;
-    QString hash;
-    qint64 time;
-};
-
-typedef QMap<unsigned, Block> BlockMap;
-typedef QMap<qint64, Block> BlockTimeMap;
-typedef QMultiMap<qint64, Block> BlockTimeMultiMap;
-
 class MainObj : public QObject
 {
 public:
     const int NDAYS;
-    explicit MainObj(int ndays) : NDAYS(ndays) {}
+    const Options opts;
+    explicit MainObj(const Options & o) : NDAYS(o.ndays), opts(o), fetcher(o.fetch), running(StatsCutoff)
+    {
+        // set up connections while the rest of startup (checkpoint, planning) happens
+        if (!opts.tlsSessionFile.isEmpty()) fetcher.setSessionCache(opts.tlsSessionFile, QUrl(opts.baseUrl));
+        if (opts.warmUp) fetcher.warmUp(QUrl(opts.baseUrl));
+    }
 
 protected:
     bool event(QEvent *event);
 private:
     void appEntry();
-    void getNext();
-    void finished(QNetworkReply *);
-    void processResults(const QJsonDocument &d);
+    void requestDay(int day);
+    void requestHeight(unsigned height);
+    void refillGaps();
+#ifdef BCG_COROUTINES
+    Coro::Task<void> downloadDays();
+    Coro::Task<void> fetchDay(int day);
+    Coro::Task<void> refill(QList<unsigned> heights);
+    Coro::Task<void> fetchHeight(unsigned height);
+#endif
+    void finish();
+    void finished(const QUrl & url, int day, const QByteArray & body);
+    void pageDone(int day, int nBlocks);
+    void startPipeline();
+    void submitPage(Pipeline::Page && p);
+    void pageIngested(int day, int nBlocks, const BlockList & fresh);
+    void saveCheckpoint();
+    void recordPage(const QUrl & url, const QByteArray & body) const;
+    void processResults(const BlockList & bl, qint64 bytes, bool refill);
+    BlockList ingest(const BlockList & bl);
     void printBlocks() const;
     void printStatsAndExit() const;
+    bool printReport() const;
+    void startWatch();
+    void startServing();
+    void publishSnapshot();
+    void poll();
+    void requestNewBlock(unsigned height);
+    void ingestLive(const Block & b);
+    void printStats() const;
     void saveCsv() const;
+    void buildIntervalIndex();
+    void printPerfSummary() const;
+    bool printBenchReport() const;
+
+    Fetcher fetcher;
+    int daysLeft;
+    qint64 startMs = 0; // opts.clock() at startup; day k is the UTC day containing startMs - k days
+    QSet<int> daysDone;
+    FetchPlanner planner;
+    int refillsLeft = 0;
+    int daysSinceCheckpoint = 0;
+    qint64 runStartNs = 0, runStartCpuNs = 0, runStartMockCpuNs = 0;
 
-    QNetworkAccessManager mgr;
-    int daysLeft, nDupeTimes;
-    QByteArray data;
+    BlockStore store;
+    Arena pageArena;     // finished(): the parse state of the page at hand
+    IntervalIndex index; // built once the download is complete
 
-    BlockMap blocks;
-    BlockTimeMap blocksByTime;
-    BlockTimeMultiMap blocksByTimeMulti;
+    // --watch
+    QTimer watchTimer;
+    QByteArray latestEtag;
+    bool pollInFlight = false;
+    unsigned requestedUpTo = 0; // highest height asked for so far
+    QSet<unsigned> failedHeights; // asked for but not ingested; asked for again on the next poll
+    RunningStats running;
+
+    // --serve
+    std::unique_ptr<QueryServer> queryServer;
+    bool publishPending = false;
+
+    Notifier notifier; // --notify-socket
+
+    // --threads: while this exists, the store belongs to its ingest thread
+    std::unique_ptr<Pipeline> pipeline;
+    int pipelinePages = 0;                // submitted and not yet ingested
+    std::deque<Pipeline::Page> backlog;   // arrived while the pipeline was full
 };
 
 bool MainObj::event(QEvent *event)
@@ -110,166 +173,706 @@ bool MainObj::event(QEvent *event)
 
 void MainObj::appEntry()
 {
-    Log() << "Connecting to blockchain.info to download last " << (daysLeft=NDAYS) << " days' worth of block times...";
-    connect(&mgr,&QNetworkAccessManager::finished, this, [this](QNetworkReply*reply){finished(reply);});
-    getNext();
+    runStartNs = Perf::nowNs();
+    runStartCpuNs = Perf::cpuTimeNs();
+    if (opts.mockCpuNs) runStartMockCpuNs = opts.mockCpuNs();
+    if (!opts.notifySocket.isEmpty()) {
+        if (!notifier.listen(opts.notifySocket))
+            Fatal("Could not listen on %s: %s", opts.notifySocket.toUtf8().constData(), notifier.errorString().toUtf8().constData());
+        Log() << "Publishing new blocks and stats to subscribers on " << opts.notifySocket;
+    }
+    Log() << "Connecting to " << QUrl(opts.baseUrl).host() << " to download last " << (daysLeft=NDAYS) << " days' worth of block times...";
+    startMs = opts.clock();
+    if (opts.resume) {
+        Checkpoint::Cursor c;
+        QString err;
+        Perf::Scope p(Perf::Checkpoint);
+        if (!QFile::exists(opts.checkpointFile)) {
+            Log() << "No checkpoint at " << opts.checkpointFile << ", starting from scratch";
+        } else if (!Checkpoint::load(opts.checkpointFile, store, c, &err)) {
+            Fatal("Could not resume from %s: %s", opts.checkpointFile.toUtf8().constData(), err.toUtf8().constData());
+        } else {
+            if (c.baseUrl != opts.baseUrl)
+                Log() << "Warning: checkpoint was made against " << c.baseUrl << ", now fetching from " << opts.baseUrl;
+            startMs = c.startMs; // keep the same day boundaries as the interrupted run
+            daysDone = c.daysDone;
+            for (int day : daysDone)
+                if (day < NDAYS) --daysLeft;
+            Log("Resuming from %s: %d blocks, %d of %d days already downloaded", opts.checkpointFile.toUtf8().constData(),
+                store.blockCount(), NDAYS - daysLeft, NDAYS);
+        }
+    }
+    planner = FetchPlanner(startMs, NDAYS);
+    if (opts.threads > 0) startPipeline();
+    if (daysLeft <= 0) {
+        refillGaps();
+        return;
+    }
+    // Every day's page is known up front, so they are all queued at once and the fetcher's
+    // rate limiter and concurrency control decide how many are in flight.
+#ifdef BCG_COROUTINES
+    Coro::spawn(downloadDays());
+#else
+    for (int day = 0; day < NDAYS; ++day)
+        if (!daysDone.contains(day))
+            requestDay(day);
+#endif
 }
 
-void MainObj::getNext()
+void MainObj::requestDay(int day)
 {
-    Log("Received %d blocks so far, currently downloading blocks for day %d",blocksByTime.size(), daysLeft-NDAYS);
-    qint64 ts = QDateTime::currentMSecsSinceEpoch();
-    if (!blocksByTime.isEmpty()) {
-        static const qint64 aday_ms = 60ll*60ll*24ll*1000ll;
-        ts = blocksByTime.first().time*1000ll - aday_ms;
-    } else {
-        nDupeTimes = 0;
+    TRACE_SCOPE("requestDay");
+    const qint64 ts = planner.dayTimestampMs(day);
+    QString urlString = QString().sprintf("%s/blocks/%lld?format=json",opts.baseUrl.toUtf8().constData(),ts);
+    const QUrl url(urlString);
+    fetcher.get(url, day, [this,url,day](const QByteArray & body){
+        finished(url, day, body);
+    }, [this](const QString & err){
+        saveCheckpoint();
+        Fatal("Giving up on %s, exiting", err.toUtf8().constData());
+    });
+}
+
+void MainObj::requestHeight(unsigned height)
+{
+    TRACE_SCOPE("requestHeight");
+    QString urlString = QString().sprintf("%s/block-height/%u?format=json",opts.baseUrl.toUtf8().constData(),height);
+    const QUrl url(urlString);
+    fetcher.get(url, height, [this,url](const QByteArray & body){
+        finished(url, -1, body);
+    }, [this](const QString & err){
+        // a hole is worth reporting, not worth losing the whole run over
+        Log() << "Could not refill: " << err;
+        if (--refillsLeft <= 0) finish();
+    });
+}
+
+void MainObj::refillGaps()
+{
+    static const int MaxRefills = 2000;
+    const QList<unsigned> gaps = planner.heightGaps(store.byHeight(), MaxRefills);
+    if (gaps.isEmpty()) {
+        finish();
+        return;
     }
-    QString urlString = QString().sprintf("https://blockchain.info/blocks/%lld?format=json",ts);
-    QNetworkReply *r = mgr.get(QNetworkRequest(QUrl(urlString)));
-    connect(r, static_cast<void(QNetworkReply::*)(QNetworkReply::NetworkError)>(&QNetworkReply::error),this,[r](QNetworkReply::NetworkError c){Fatal("Got network error code: %d, exiting",int(c));});
-    connect(r, &QIODevice::readyRead, this, [this,r]{
-         data += r->readAll();
+    Log("Found %d missing height(s) between %u and %u, fetching them", gaps.size(), store.byHeight().firstKey(), store.byHeight().lastKey());
+    refillsLeft = gaps.size();
+#ifdef BCG_COROUTINES
+    Coro::spawn(refill(gaps));
+#else
+    for (unsigned h : gaps)
+        requestHeight(h);
+#endif
+}
+
+#ifdef BCG_COROUTINES
+// The same requests as requestDay()/requestHeight(), written as coroutines: one frame per
+// page, resumed from the fetcher's callbacks on this thread, and the pages fanned out with
+// whenAll. finished() does the per-page bookkeeping either way.
+Coro::Task<void> MainObj::downloadDays()
+{
+    std::vector<Coro::Task<void>> days;
+    for (int day = 0; day < NDAYS; ++day)
+        if (!daysDone.contains(day))
+            days.push_back(fetchDay(day));
+    co_await Coro::whenAll(std::move(days));
+}
+
+Coro::Task<void> MainObj::fetchDay(int day)
+{
+    const QUrl url(QString().sprintf("%s/blocks/%lld?format=json", opts.baseUrl.toUtf8().constData(), planner.dayTimestampMs(day)));
+    const Coro::FetchResult r = co_await Coro::fetch(fetcher, url, day);
+    if (!r.ok) {
+        saveCheckpoint();
+        Fatal("Giving up on %s, exiting", r.error.toUtf8().constData());
+    }
+    finished(url, day, r.body);
+}
+
+Coro::Task<void> MainObj::refill(QList<unsigned> heights)
+{
+    std::vector<Coro::Task<void>> pages;
+    for (unsigned h : heights)
+        pages.push_back(fetchHeight(h));
+    co_await Coro::whenAll(std::move(pages));
+}
+
+Coro::Task<void> MainObj::fetchHeight(unsigned height)
+{
+    const QUrl url(QString().sprintf("%s/block-height/%u?format=json", opts.baseUrl.toUtf8().constData(), height));
+    const Coro::FetchResult r = co_await Coro::fetch(fetcher, url, height);
+    if (!r.ok) {
+        // a hole is worth reporting, not worth losing the whole run over
+        Log() << "Could not refill: " << r.error;
+        if (--refillsLeft <= 0) finish();
+        co_return;
+    }
+    finished(url, -1, r.body);
+}
+#endif
+
+void MainObj::finish()
+{
+    pipeline.reset(); // idle by now; the store is the event loop thread's again
+    saveCheckpoint(); // so a later --resume with more days only fetches the new ones
+    buildIntervalIndex();
+    if (opts.watchSecs <= 0 && opts.servePort == 0) {
+        printStatsAndExit();
+        return;
+    }
+    printReport();
+    if (opts.servePort > 0)
+        startServing();
+    if (opts.watchSecs > 0)
+        startWatch();
+}
+
+void MainObj::startServing()
+{
+    queryServer.reset(new QueryServer(opts.serveThreads > 0 ? opts.serveThreads : QThread::idealThreadCount()));
+    queryServer->publish(store);
+    if (!queryServer->start(QHostAddress(opts.serveAddress), opts.servePort))
+        Fatal("Could not listen on %s:%d: %s", opts.serveAddress.toUtf8().constData(), int(opts.servePort),
+              queryServer->errorString().toUtf8().constData());
+    Log("Serving queries on http://%s:%d", opts.serveAddress.toUtf8().constData(), int(queryServer->serverPort()));
+}
+
+// Rebuilding the snapshot is O(blocks), so blocks arriving together in one poll share one rebuild.
+void MainObj::publishSnapshot()
+{
+    if (!queryServer || publishPending) return;
+    publishPending = true;
+    QTimer::singleShot(0, this, [this]{
+        publishPending = false;
+        queryServer->publish(store);
     });
 }
 
+void MainObj::startWatch()
+{
+    running.reset(store.byTime().times(), store.dupeTimes());
+    notifier.publishStats(running.stats(), running.quantile(0.5), running.quantile(0.99));
+    requestedUpTo = store.isEmpty() ? 0 : store.byHeight().lastKey();
+    Log("Watching for new blocks every %d s", opts.watchSecs);
+    connect(&watchTimer, &QTimer::timeout, this, [this]{ poll(); });
+    watchTimer.start(opts.watchSecs * 1000);
+    poll();
+}
+
+void MainObj::poll()
+{
+    if (pollInFlight) return; // the last one is still retrying
+    pollInFlight = true;
+    Perf::count(Perf::Polls);
+    // heights that failed last time go again, whether or not the tip has moved
+    QSet<unsigned> retry;
+    retry.swap(failedHeights);
+    for (unsigned height : retry)
+        requestNewBlock(height);
+    const QUrl url(opts.baseUrl + "/latestblock");
+    // conditional, so an unchanged tip costs a bodyless 304
+    fetcher.getConditional(url, latestEtag, -1, [this](int status, const QByteArray & body, const QByteArray & etag){
+        pollInFlight = false;
+        if (status == 304) {
+            Perf::count(Perf::PollsNotModified);
+            return;
+        }
+        latestEtag = etag;
+        const QJsonValue h = QJsonDocument::fromJson(body).object().value(QLatin1String("height"));
+        if (!h.isDouble()) {
+            Log("Unexpected /latestblock response, ignoring");
+            return;
+        }
+        static const unsigned MaxPerPoll = 100; // after a long outage, catch up over several polls
+        const unsigned tip = std::min(unsigned(h.toDouble()), requestedUpTo + MaxPerPoll);
+        for (unsigned height = requestedUpTo + 1; height <= tip; ++height)
+            requestNewBlock(height);
+        requestedUpTo = std::max(requestedUpTo, tip);
+    }, [this](const QString & err){
+        pollInFlight = false;
+        Log() << "Poll failed: " << err;
+    });
+}
 
+void MainObj::requestNewBlock(unsigned height)
+{
+    QString urlString = QString().sprintf("%s/block-height/%u?format=json",opts.baseUrl.toUtf8().constData(),height);
+    fetcher.get(QUrl(urlString), height, [this,height](const QByteArray & body){
+        BlockList bl;
+        QString err;
+        if (!BlockParser::parseJson(QJsonDocument::fromJson(body), bl, &err)) {
+            Log() << "Bad block page: " << err << ", will try again";
+            failedHeights.insert(height);
+            return;
+        }
+        for (const Block & b : bl)
+            ingestLive(b);
+    }, [this,height](const QString & err){
+        // running stats take late blocks in any order, so the next poll can fill this in
+        Log() << "Could not fetch new block: " << err << ", will try again";
+        failedHeights.insert(height);
+    });
+}
 
-void MainObj::finished(QNetworkReply *r)
+void MainObj::ingestLive(const Block & b)
 {
-    data += r->readAll();
-//    Log("Got data length: %d\n%s\n", data.length(), data.constData());
-    QJsonParseError e;
-    QJsonDocument d = QJsonDocument::fromJson(data, &e);
-    if (d.isNull()) {
-        Fatal("error parsing JSON: %s", e.errorString().toLatin1().constData());
+    const qint64 t0 = Perf::nowNs();
+    const bool newTime = !store.byTime().contains(b.time);
+    for (const Block & fresh : ingest(BlockList{b}))
+        notifier.publishBlock(fresh);
+    if (newTime) running.addTime(b.time);
+    else running.addDupe();
+    const IntervalStats s = running.stats();
+    const qint64 median = running.quantile(0.5), p99 = running.quantile(0.99);
+    const qint64 dt = Perf::nowNs() - t0;
+    Perf::record(Perf::Update, dt);
+    publishSnapshot();
+    notifier.publishStats(s, median, p99);
+    Log("New block %u (time %lld): %d blocks, avg %f mins, median %f mins, p99 %f mins, cutoff avg %f mins [updated in %.1f us]",
+        b.height, b.time, s.nBlocks, s.avg/60., median/60., p99/60., s.nCutoff ? double(s.cutoffDeltaSums)/double(s.nCutoff)/60. : 0., dt/1e3);
+}
+
+// day < 0: a single-height refill page rather than a day page
+void MainObj::finished(const QUrl & url, int day, const QByteArray & body)
+{
+    TRACE_SCOPE("finished");
+    if (!opts.recordDir.isEmpty() && day >= 0) recordPage(url, body);
+    if (pipeline) {
+        Pipeline::Page p;
+        p.tag = day;
+        p.body = body;
+        submitPage(std::move(p));
+        return;
+    }
+    BlockList bl;
+    QString err;
+    bool ok;
+    {
+        Perf::Scope p(Perf::Parse);
+        ok = BlockParser::parsePage(body, pageArena, bl, &err);
+    }
+    if (!ok) {
+        saveCheckpoint();
+        Fatal("%s", err.toUtf8().constData());
     } else {
-        processResults(d);
+        Perf::Scope p(Perf::Ingest);
+        processResults(bl, body.size(), day < 0);
         //printBlocks();
     }
-    data.clear();
-    r->deleteLater();
-    if (--daysLeft > 0)
-        getNext();
-    else
-        printStatsAndExit();
+    pageArena.reset(); // the page's parse state goes in one step
+    pageDone(day, store.byTime().size());
 }
 
-void MainObj::printStatsAndExit() const
+// Bookkeeping once a page is in the store. nBlocks: distinct timestamps stored so far.
+void MainObj::pageDone(int day, int nBlocks)
 {
-    int nBlocks = blocksByTime.size() + nDupeTimes;
-    double days = blocksByTime.empty() ? 0.0 : double(blocksByTime.last().time-blocksByTime.first().time)/60./60./24.;
-    Log("Got %d blocks, spanning %g days, computing stats...",nBlocks, days);
-    double avg = 0.;
-    qint64 last = -1, min = nDupeTimes ? 0ll : LONG_MAX, max = -1;
-    qint64 mycutoff = 7ll*60ll+30ll; // 7.5 mins
-    qint64 cutoffdeltasums = 0ll, nsums = 0ll;
-    for (const Block & b : blocksByTime) {
-        if (last > -1) {
-            qint64 delta = b.time-last;
-            if (delta < 0LL) {
-                Fatal("Block=%d delta=%lld! Aborting!", b.height, delta);
-            } else {
-                avg += double(delta) / double(nBlocks>0?nBlocks:1);
-                if (delta < min) min = delta;
-                if (delta > max) max = delta;
-            }
-            if (delta >= mycutoff) {
-                cutoffdeltasums += delta-mycutoff;
-                ++nsums;
-            }
-        }
-        last = b.time;
+    if (day < 0) {
+        if (--refillsLeft <= 0) finish();
+        return;
     }
-    Log("Avg time: %f mins, min=%f mins, max=%f mins", avg/60., min/60., max/60.);
-    Log("Craig vs Peter R test -- cutoff time: %f mins, avg: %f mins", mycutoff/60., double(cutoffdeltasums/double(nsums))/60.);
-    saveCsv();
+    daysDone.insert(day);
+    Log("Received %d blocks so far, %d day(s) still to download", nBlocks, daysLeft-1);
+    if (--daysLeft <= 0) {
+        refillGaps();
+    } else if (opts.checkpointEvery > 0 && ++daysSinceCheckpoint >= opts.checkpointEvery) {
+        saveCheckpoint();
+    }
+}
+
+void MainObj::saveCheckpoint()
+{
+    if (opts.checkpointEvery <= 0) return;
+    Perf::Scope p(Perf::Checkpoint);
+    Checkpoint::Cursor c;
+    c.startMs = startMs;
+    c.daysDone = daysDone;
+    c.baseUrl = opts.baseUrl;
+    auto save = [this,&c]{
+        QString err;
+        if (!store.isEmpty() && !Checkpoint::save(opts.checkpointFile, store, c, &err))
+            Log() << "Could not write checkpoint " << opts.checkpointFile << ": " << err;
+    };
+    // pages ingested but not yet in daysDone are simply fetched again on --resume
+    if (pipeline) pipeline->runOnIngestThread(save);
+    else save();
+    daysSinceCheckpoint = 0;
+}
+
+void MainObj::startPipeline()
+{
+    auto parse = [](Pipeline::Page & p) {
+        static thread_local Arena arena; // one per parser thread
+        Perf::Scope s(Perf::Parse);
+        BlockParser::parsePage(p.body, arena, p.blocks, &p.error);
+        arena.reset();
+    };
+    // the ingest thread owns the store and planner until finish(); results go back to the event loop
+    auto ingestPage = [this](Pipeline::Page & p) {
+        if (!p.error.isEmpty()) {
+            const QString err = p.error;
+            QMetaObject::invokeMethod(this, [this,err]{
+                saveCheckpoint();
+                Fatal("%s", err.toUtf8().constData());
+            }, Qt::QueuedConnection);
+            return;
+        }
+        BlockList fresh;
+        int nBlocks;
+        {
+            Perf::Scope s(Perf::Ingest);
+            planner.pageFetched(p.blocks, p.bytes, store.byHeight(), p.tag < 0);
+            fresh = ingest(p.blocks);
+            nBlocks = store.byTime().size();
+        }
+        const int day = p.tag;
+        QMetaObject::invokeMethod(this, [this,day,nBlocks,fresh]{ pageIngested(day, nBlocks, fresh); }, Qt::QueuedConnection);
+    };
+    pipeline.reset(new Pipeline(opts.threads, PipelineDepth, parse, ingestPage));
+    Log("Parsing on %d thread(s), ingesting on another", opts.threads);
+}
+
+// Pages the pipeline can't take yet wait in the backlog, and the fetcher is held while the
+// pipeline is full, so at most a round of in-flight requests ever piles up here.
+void MainObj::submitPage(Pipeline::Page && p)
+{
+    ++pipelinePages;
+    backlog.push_back(std::move(p));
+    while (!backlog.empty() && pipeline->submit(std::move(backlog.front())))
+        backlog.pop_front();
+    fetcher.setHold(!backlog.empty() || pipelinePages >= pipeline->capacity());
+    Perf::setGauge(Perf::PipelinePages, pipelinePages);
+}
+
+void MainObj::pageIngested(int day, int nBlocks, const BlockList & fresh)
+{
+    --pipelinePages;
+    while (!backlog.empty() && pipeline->submit(std::move(backlog.front())))
+        backlog.pop_front();
+    fetcher.setHold(!backlog.empty() || pipelinePages >= pipeline->capacity());
+    Perf::setGauge(Perf::PipelinePages, pipelinePages);
+    for (const Block & b : fresh)
+        notifier.publishBlock(b);
+    pageDone(day, nBlocks);
+}
+
+void MainObj::recordPage(const QUrl & url, const QByteArray & body) const
+{
+    const qint64 ms = url.path().section('/', -1).toLongLong();
+    QFile f(QDir(opts.recordDir).filePath(QString("%1.json").arg(ms / (24ll*60ll*60ll*1000ll))));
+    if (!f.open(QIODevice::WriteOnly|QIODevice::Truncate) || f.write(body) != body.size())
+        Fatal("Could not write %s", f.fileName().toUtf8().constData());
+}
+
+void MainObj::buildIntervalIndex()
+{
+    Perf::Scope p(Perf::Stats);
+    index.build(store.byTime().times());
+}
+
+void MainObj::printStatsAndExit() const
+{
+    const bool withinBudget = printReport();
     Log("Done.");
-    qApp->exit(0);
+    qApp->exit(withinBudget ? 0 : 3);
+}
+
+// returns false if a --bench-e2e budget was missed
+bool MainObj::printReport() const
+{
+    printStats();
+    for (const QString & line : planner.summaryLines(store))
+        Log() << line;
+    saveCsv();
+    printPerfSummary();
+    return !opts.benchE2e || printBenchReport();
+}
+
+bool MainObj::printBenchReport() const
+{
+    const double wall = double(Perf::nowNs() - runStartNs) / 1e9;
+    const double mockCpu = opts.mockCpuNs ? double(opts.mockCpuNs() - runStartMockCpuNs) / 1e9 : 0.;
+    const double cpu = double(Perf::cpuTimeNs() - runStartCpuNs) / 1e9 - mockCpu;
+    const double rss = double(Perf::peakRssBytes()) / (1024.*1024.);
+    const double rate = wall > 0. ? double(store.blockCount()) / wall : 0.;
+    bool ok = true;
+    auto check = [&ok](double value, double budget, bool isMinimum) -> QString {
+        if (budget <= 0.) return QString();
+        const bool over = isMinimum ? value < budget : value > budget;
+        if (over) ok = false;
+        return QString().sprintf(" (budget %s%g%s)", isMinimum ? ">= " : "<= ", budget, over ? ", FAILED" : "");
+    };
+    if (opts.fetch.lean)
+        Log("End-to-end benchmark (lean HTTP client, %d connections, pipelining %d):", opts.fetch.http.connections, opts.fetch.http.pipelining);
+    else
+        Log("End-to-end benchmark (QNetworkAccessManager):");
+    Log("  blocks/s   %12.1f%s", rate, check(rate, opts.budgetMinBlocksPerSec, true).toUtf8().constData());
+    Log("  wall s     %12.3f%s", wall, check(wall, opts.budgetWallSecs, false).toUtf8().constData());
+    Log("  cpu s      %12.3f%s", cpu, check(cpu, opts.budgetCpuSecs, false).toUtf8().constData());
+    Log("  peak MiB   %12.1f%s", rss, check(rss, opts.budgetRssMiB, false).toUtf8().constData());
+    Log("  (cpu s leaves out the mock's %.3f s; peak MiB is the whole process, mock included)", mockCpu);
+    if (!ok) Log("End-to-end benchmark is over budget");
+    return ok;
+}
+
+void MainObj::printPerfSummary() const
+{
+    Log("Performance summary:");
+    for (const QString & line : Perf::summaryLines())
+        Log() << line;
+    for (const QString & line : fetcher.connectionSummary())
+        Log() << line;
+    const quint64 pages = Perf::histogram(Perf::Parse).count();
+    if (AllocTrack::enabled() && pages) {
+        const AllocTrack::Counters c = AllocTrack::counters(Perf::Parse);
+        Log("Parsing: %.1f heap allocations (%.1f KiB) per page", double(c.allocs) / double(pages), double(c.bytes) / double(pages) / 1024.);
+    }
+    if (pageArena.highWater())
+        Log("Page arena: %.1f KiB at most per page, in %d chunk(s)", double(pageArena.highWater()) / 1024., pageArena.chunks());
+    if (!opts.perfJsonFile.isEmpty()) {
+        if (Perf::saveJson(opts.perfJsonFile))
+            Log() << "Saved performance report to " << opts.perfJsonFile;
+        else
+            Log() << "Could not write performance report to " << opts.perfJsonFile;
+    }
+}
+
+void MainObj::printStats() const
+{
+    Perf::Scope p(Perf::Stats);
+    const TimeColumn & times = index.timeColumn();
+    double days = times.isEmpty() ? 0.0 : double(times.back()-times.front())/60./60./24.;
+    Log("Got %d blocks, spanning %g days, computing stats...",store.blockCount(), days);
+    Log("Time column: %d timestamps in %d bytes (%d bytes uncompressed)", int(times.size()), int(times.bytesUsed()), int(times.size()*sizeof(qint64)));
+    const qint64 mycutoff = StatsCutoff;
+    const IntervalStats s = computeIntervalStats(times, store.blockCount(), store.dupeTimes(), mycutoff, TaskPool::global());
+    Log("Avg time: %f mins, min=%f mins, max=%f mins", s.avg/60., s.min/60., s.max/60.);
+    Log("Craig vs Peter R test -- cutoff time: %f mins, avg: %f mins", mycutoff/60., double(s.cutoffDeltaSums/double(s.nCutoff))/60.);
+    if (!index.isEmpty()) {
+        const qint64 from = times.front(), to = times.back()+1;
+        Log("Median time: %f mins, p99=%f mins", index.quantile(from, to, 0.5)/60., index.quantile(from, to, 0.99)/60.);
+    }
 }
 
 void MainObj::saveCsv() const
 {
+    Perf::Scope p(Perf::Csv);
     QFile f("blocks_sorted_by_height.csv"), f2("blocks_sorted_by_timestamp.csv");
     if (!f.open(QIODevice::WriteOnly))
         Fatal("Could not open %s in current directory for writing!",f.fileName().toUtf8().constData());
-    f.write(QString().sprintf("#BlockHeight,BlockTimeUTC,BlockHash\n").toUtf8());
-    for(const Block & b: blocks) {
-        f.write(QString().sprintf("%d,%lld,%s\n",b.height,b.time,b.hash.toUtf8().constData()).toUtf8());
-    }
-    f.flush();
-    f.close();
     if (!f2.open(QIODevice::WriteOnly))
         Fatal("Could not open %s in current directory for writing!",f2.fileName().toUtf8().constData());
-    f2.write(QString().sprintf("#BlockTimeUTC,BlockHeight,BlockHash\n").toUtf8());
-    for(const Block & b: blocks) {
-        f2.write(QString().sprintf("%lld,%d,%s\n",b.time,b.height,b.hash.toUtf8().constData()).toUtf8());
-    }
+    // the two files are independent, so they are formatted and written side by side
+    TaskGroup g;
+    g.run([this,&f]{ Csv::write(f, store.byHeight(), Csv::HeightTimeHash); });
+    Csv::write(f2, store.byHeight(), Csv::TimeHeightHash);
+    g.wait();
+    f.flush();
+    f.close();
     f2.flush();
     f2.close();
     Log() << "Saved " << f.fileName() << " and " << f2.fileName() << " to the current directory";
 }
 
-void MainObj::processResults(const QJsonDocument &d)
+void MainObj::processResults(const BlockList & bl, qint64 bytes, bool refill)
 {
-    if (d.isObject()) {
-        QVariantMap vm = d.object().toVariantMap();
-        QList<QVariant> vl;
-        if (!vm.contains("blocks") || (vl=vm["blocks"].toList()).isEmpty() ) {
-            Fatal("Blocks array not found");
-        } else {
-            for(const QVariant & v : vl) {
-                vm = v.toMap();
-                if (vm.isEmpty()) {
-                    Fatal("variantMap is empty");
-                } else {
-                    Block b;
-                    bool ok1,ok2;
-                    b.height = vm["height"].toUInt(&ok1);
-                    b.hash = vm["hash"].toString();
-                    b.time = vm["time"].toLongLong(&ok2);
-                    bool main = vm["main_chain"].toBool();
-                    if (!main) continue;
-                    if (!ok1 || !ok2) Fatal("Parse error");
-                    else {
-                        if (blocks.contains(b.height))
-                            Log("Dupe block found %d (dup2: time=%lld hash=%s / dup1: time=%lld hash=%s)", b.height
-                                , b.time, b.hash.toUtf8().constData()
-                                , blocks[b.height].time, blocks[b.height].hash.toUtf8().constData());
-                        if (blocksByTime.contains(b.time)) {
-                            Log("Dupe timestamp found %d (dup2: height=%d hash=%s / dup1: height=%d hash=%s)", b.time
-                                , b.height, b.hash.toUtf8().constData()
-                                , blocksByTime[b.time].height, blocksByTime[b.time].hash.toUtf8().constData());
-                            ++nDupeTimes;
-                        }
-                        blocks[b.height] = b;
-                        blocksByTime[b.time] = b;
-                        blocksByTimeMulti.insert(b.time, b);
-                    }
-                }
-            }
-        }
-    } else {
-        Fatal("Unknown Json type");
-    }
+    planner.pageFetched(bl, bytes, store.byHeight(), refill);
+    for (const Block & b : ingest(bl))
+        notifier.publishBlock(b);
+}
+
+// store.ingest, plus the ingest counters (--metrics-port) for the batch as a whole. Returns
+// the blocks at new heights, for --notify-socket. Called on the ingest thread with --threads.
+BlockList MainObj::ingest(const BlockList & bl)
+{
+    const int heights = store.byHeight().size(), dupeTimes = store.dupeTimes();
+    BlockList fresh;
+    if (!opts.notifySocket.isEmpty())
+        for (const Block & b : bl)
+            if (!store.byHeight().contains(b.height)) fresh.append(b);
+    store.ingest(bl);
+    Perf::count(Perf::BlocksIngested, bl.size());
+    Perf::count(Perf::DupeHeights, bl.size() - (store.byHeight().size() - heights));
+    Perf::count(Perf::DupeTimes, store.dupeTimes() - dupeTimes);
+    return fresh;
 }
 
 void MainObj::printBlocks() const
 {
-    for (auto & b : blocks) {
+    for (auto & b : store.byHeight()) {
         Log() << b.height << ":" << b.hash << ":" << b.time;
     }
 }
 
 int main(int argc, char *argv[])
 {
-    int ndays;
-    if (argc < 2 || (ndays=QString(argv[1]).toInt()) <= 0) {
+    Perf::nowNs(); // start the monotonic clock
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Downloads block times from blockchain.info and computes block interval stats.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("days", "Number of days' worth of blocks to download.");
+    QCommandLineOption perfJsonOpt("perf-json", "Write per-phase timings as JSON to <file> at exit.", "file");
+    parser.addOption(perfJsonOpt);
+    QCommandLineOption traceOpt("trace", "Record a Chrome trace-event file (chrome://tracing, Perfetto) to <file>.", "file");
+    parser.addOption(traceOpt);
+    QCommandLineOption baseUrlOpt("base-url", "Fetch pages from <url> instead of https://blockchain.info (e.g. a local mockserver).", "url");
+    parser.addOption(baseUrlOpt);
+    QCommandLineOption recordOpt("record", "Save every downloaded page to <dir>, for replay with mockserver --record-dir.", "dir");
+    parser.addOption(recordOpt);
+    QCommandLineOption nowOpt("now", "Use <ms> since the epoch as the current time, for reproducible runs.", "ms");
+    parser.addOption(nowOpt);
+    QCommandLineOption timeoutOpt("timeout", "Abort and retry a request that takes longer than <ms> (0 = never).", "ms", "60000");
+    parser.addOption(timeoutOpt);
+    QCommandLineOption retriesOpt("retries", "Retry a failed request up to <n> times, with exponential backoff.", "n", "6");
+    parser.addOption(retriesOpt);
+    QCommandLineOption rateOpt("rate", "Send at most <n> requests per second (0 = unlimited).", "n", "10");
+    parser.addOption(rateOpt);
+    QCommandLineOption concurrencyOpt("max-concurrency", "Never have more than <n> requests in flight; the actual limit adapts between 1 and <n>.", "n", "6");
+    parser.addOption(concurrencyOpt);
+    QCommandLineOption httpOpt("http", "HTTP client: qt (QNetworkAccessManager) or lean (persistent connections with optional pipelining; raise --max-concurrency to use more than 6).", "client", "qt");
+    parser.addOption(httpOpt);
+    QCommandLineOption connectionsOpt("connections", "With --http lean, open up to <n> connections to the server.", "n", "6");
+    parser.addOption(connectionsOpt);
+    QCommandLineOption pipelineOpt("pipeline", "With --http lean, send up to <n> requests down a connection before the first is answered.", "n", "1");
+    parser.addOption(pipelineOpt);
+    QCommandLineOption noCompressOpt("no-compress", "Don't ask for gzip/deflate-compressed pages.");
+    parser.addOption(noCompressOpt);
+    QCommandLineOption noWarmUpOpt("no-warmup", "Don't resolve the host and open connections before the first request.");
+    parser.addOption(noWarmUpOpt);
+    QCommandLineOption tlsCacheOpt("tls-session-cache", "Keep the TLS session in the user's cache directory, readable by them only, so the next run can resume it.");
+    parser.addOption(tlsCacheOpt);
+    QCommandLineOption noHedgeOpt("no-hedge", "Don't send a duplicate of a request that runs past the p95 latency.");
+    parser.addOption(noHedgeOpt);
+    QCommandLineOption checkpointOpt("checkpoint", "Checkpoint file (default: blocks.checkpoint in the current directory).", "file");
+    parser.addOption(checkpointOpt);
+    QCommandLineOption checkpointEveryOpt("checkpoint-every", "Write a checkpoint after every <n> days downloaded (0 = never).", "n", "25");
+    parser.addOption(checkpointEveryOpt);
+    QCommandLineOption resumeOpt("resume", "Continue an interrupted run from its checkpoint, downloading only the missing days.");
+    parser.addOption(resumeOpt);
+    QCommandLineOption watchOpt("watch", "After the download, keep polling for new blocks every <secs> and update the stats as they arrive.", "secs");
+    parser.addOption(watchOpt);
+    QCommandLineOption serveOpt("serve", "After the download, keep running and answer HTTP/JSON queries about the blocks on <port>.", "port");
+    parser.addOption(serveOpt);
+    QCommandLineOption serveBindOpt("serve-bind", "With --serve or --metrics-port, listen on <address>.", "address", "127.0.0.1");
+    parser.addOption(serveBindOpt);
+    QCommandLineOption serveThreadsOpt("serve-threads", "With --serve, answer queries on <n> threads (default: one per core).", "n", "0");
+    parser.addOption(serveThreadsOpt);
+    QCommandLineOption metricsOpt("metrics-port", "Serve live Prometheus metrics (request latency, in-flight requests, bytes, blocks and dupes ingested, phase times) on <port> at /metrics.", "port");
+    parser.addOption(metricsOpt);
+    QCommandLineOption notifyOpt("notify-socket", "Push new blocks and, with --watch, updated stats as JSON lines to subscribers of local socket <name>.", "name");
+    parser.addOption(notifyOpt);
+    QCommandLineOption threadsOpt("threads", "Parse pages on <n> threads and ingest them on another, leaving the event loop thread to the network (0 = do everything on it).", "n", "0");
+    parser.addOption(threadsOpt);
+    QCommandLineOption benchOpt("bench-e2e", "Benchmark the whole run against an in-process mock server and report blocks/s, wall and CPU time and peak RSS.");
+    parser.addOption(benchOpt);
+    QCommandLineOption rttOpt("rtt", "With --bench-e2e, simulated round-trip time per request.", "ms", "50");
+    parser.addOption(rttOpt);
+    QCommandLineOption benchCompressOpt("bench-compress", "With --bench-e2e, have the mock deflate its pages (its CPU time is not counted either way).");
+    parser.addOption(benchCompressOpt);
+    QCommandLineOption budgetWallOpt("budget-wall", "With --bench-e2e, fail (exit status 3) if the run takes longer than <secs>.", "secs");
+    parser.addOption(budgetWallOpt);
+    QCommandLineOption budgetCpuOpt("budget-cpu", "With --bench-e2e, fail if the run uses more than <secs> of CPU time.", "secs");
+    parser.addOption(budgetCpuOpt);
+    QCommandLineOption budgetRssOpt("budget-rss", "With --bench-e2e, fail if peak RSS exceeds <mib>.", "mib");
+    parser.addOption(budgetRssOpt);
+    QCommandLineOption budgetRateOpt("budget-rate", "With --bench-e2e, fail if fewer than <n> blocks/s are processed.", "n");
+    parser.addOption(budgetRateOpt);
+    parser.process(app);
+
+    Options opts;
+    const QStringList args = parser.positionalArguments();
+    if (args.isEmpty() || (opts.ndays=args.first().toInt()) <= 0) {
         Log("Please pass the number of days' worth of blocks to download as the first argument");
         return 1;
     }
-    MainObj obj(ndays);
-    QCoreApplication app(argc, argv);
+    opts.perfJsonFile = parser.value(perfJsonOpt);
+    if (parser.isSet(baseUrlOpt)) opts.baseUrl = parser.value(baseUrlOpt);
+    while (opts.baseUrl.endsWith('/')) opts.baseUrl.chop(1);
+    opts.recordDir = parser.value(recordOpt);
+    opts.fetch.timeoutMs = parser.value(timeoutOpt).toInt();
+    opts.fetch.maxRetries = parser.value(retriesOpt).toInt();
+    opts.fetch.hedge = !parser.isSet(noHedgeOpt);
+    if (parser.isSet(checkpointOpt)) opts.checkpointFile = parser.value(checkpointOpt);
+    opts.checkpointEvery = parser.value(checkpointEveryOpt).toInt();
+    opts.resume = parser.isSet(resumeOpt);
+    opts.watchSecs = parser.value(watchOpt).toInt();
+    opts.servePort = quint16(parser.value(serveOpt).toUInt());
+    opts.serveAddress = parser.value(serveBindOpt);
+    opts.serveThreads = parser.value(serveThreadsOpt).toInt();
+    opts.notifySocket = parser.value(notifyOpt);
+    opts.threads = parser.value(threadsOpt).toInt();
+    opts.fetch.rate = parser.value(rateOpt).toDouble();
+    opts.fetch.maxConcurrency = parser.value(concurrencyOpt).toInt();
+    if (parser.value(httpOpt) != "qt" && parser.value(httpOpt) != "lean")
+        Fatal("--http must be qt or lean");
+    opts.fetch.lean = parser.value(httpOpt) == "lean";
+    opts.fetch.compress = !parser.isSet(noCompressOpt);
+    opts.warmUp = !parser.isSet(noWarmUpOpt);
+    if (parser.isSet(tlsCacheOpt))
+        opts.tlsSessionFile = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tls-session";
+    opts.fetch.http.connections = parser.value(connectionsOpt).toInt();
+    opts.fetch.http.pipelining = parser.value(pipelineOpt).toInt();
+    if (!opts.recordDir.isEmpty() && !QDir().mkpath(opts.recordDir))
+        Fatal("Could not create %s", opts.recordDir.toUtf8().constData());
+    if (parser.isSet(nowOpt)) {
+        const qint64 now = parser.value(nowOpt).toLongLong();
+        opts.clock = [now]{ return now; };
+    }
+    if (!(opts.traceFile = parser.value(traceOpt)).isEmpty()) {
+        Trace::start(opts.traceFile);
+        Trace::setThreadName("main");
+    }
+
+    // The mock gets its own thread so its latency timers and writes don't queue behind the
+    // pipeline, and so its CPU time can be read off that thread and taken out of the total.
+    // It serves uncompressed pages unless asked, to keep its zlib buffers out of the peak RSS.
+    QThread mockThread;
+    MockServer *mock = nullptr;
+    if ((opts.benchE2e = parser.isSet(benchOpt))) {
+        static const qint64 BenchNowMs = 1500000000000ll; // fixed, so every run sees the same chain
+        const qint64 now = parser.isSet(nowOpt) ? parser.value(nowOpt).toLongLong() : BenchNowMs;
+        MockServer::Config mc;
+        mc.latencyMs = parser.value(rttOpt).toInt();
+        mc.tipTime = now / 1000ll;
+        mc.compress = parser.isSet(benchCompressOpt);
+        mock = new MockServer(mc);
+        mock->moveToThread(&mockThread);
+        mockThread.start();
+        bool listening = false;
+        QMetaObject::invokeMethod(mock, [mock,&listening]{ listening = mock->start(); }, Qt::BlockingQueuedConnection);
+        if (!listening)
+            Fatal("Could not start the benchmark mock server: %s", mock->errorString().toUtf8().constData());
+        opts.baseUrl = mock->baseUrl();
+        opts.mockCpuNs = [mock]{
+            qint64 ns = 0;
+            QMetaObject::invokeMethod(mock, [&ns]{ ns = Perf::threadCpuTimeNs(); }, Qt::BlockingQueuedConnection);
+            return ns;
+        };
+        opts.clock = [now]{ return now; };
+        opts.budgetWallSecs = parser.value(budgetWallOpt).toDouble();
+        opts.budgetCpuSecs = parser.value(budgetCpuOpt).toDouble();
+        opts.budgetRssMiB = parser.value(budgetRssOpt).toDouble();
+        opts.budgetMinBlocksPerSec = parser.value(budgetRateOpt).toDouble();
+    }
+
+    std::unique_ptr<MetricsServer> metrics;
+    if (parser.isSet(metricsOpt)) {
+        const quint16 port = quint16(parser.value(metricsOpt).toUInt());
+        metrics.reset(new MetricsServer);
+        if (!metrics->start(QHostAddress(opts.serveAddress), port))
+            Fatal("Could not listen on %s:%d: %s", opts.serveAddress.toUtf8().constData(), int(port),
+                  metrics->errorString().toUtf8().constData());
+        Log("Serving metrics on http://%s:%d/metrics", opts.serveAddress.toUtf8().constData(), int(metrics->serverPort()));
+    }
+
+    MainObj obj(opts);
     app.postEvent(&obj, new QEvent(QEvent::User));
-    return app.exec();
+    const int ret = app.exec();
+    if (mock) {
+        QMetaObject::invokeMethod(mock, [mock]{ mock->close(); }, Qt::BlockingQueuedConnection);
+        mockThread.quit();
+        mockThread.wait();
+        delete mock;
+    }
+    return ret;
 }
@@ -0,0 +1,48 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "Log.h"
+#include "MockServer.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Serves blockchain.info-shaped /blocks/<ms>?format=json pages for hermetic BlockChainGrok runs.");
+    parser.addHelpOption();
+    QCommandLineOption portOpt("port", "Port to listen on (default: any free port).", "port", "0");
+    QCommandLineOption latencyOpt("latency", "Delay before each response, in ms.", "ms", "0");
+    QCommandLineOption bandwidthOpt("bandwidth", "Per-connection bandwidth cap in bytes/s (0 = unlimited).", "bytes", "0");
+    QCommandLineOption chunkOpt("chunk", "Send bodies chunked, in chunks of <bytes> (0 = Content-Length).", "bytes", "0");
+    QCommandLineOption errorOpt("error-rate", "Fraction of requests answered with HTTP 500.", "rate", "0");
+    QCommandLineOption dropOpt("drop-rate", "Fraction of requests whose connection is dropped.", "rate", "0");
+    QCommandLineOption seedOpt("seed", "Seed for the synthetic chain and error injection.", "seed", "1");
+    QCommandLineOption recordOpt("record-dir", "Serve recorded pages from <dir> (as written by BlockChainGrok --record).", "dir");
+    QCommandLineOption tipOpt("tip-time", "Synthetic chain tip time in seconds since the epoch (default: now).", "secs", "0");
+    QCommandLineOption spacingOpt("spacing", "Synthetic chain mean block interval in seconds.", "secs", "600");
+    QCommandLineOption gapOpt("gap-rate", "Fraction of synthetic blocks left out of /blocks pages (still served by /block-height).", "rate", "0");
+    QCommandLineOption liveOpt("live", "Let the synthetic chain tip advance in real time (for BlockChainGrok --watch).");
+    QCommandLineOption identityOpt("no-compress", "Never compress pages, even for clients that accept deflate.");
+    parser.addOptions({portOpt, latencyOpt, bandwidthOpt, chunkOpt, errorOpt, dropOpt, seedOpt, recordOpt, tipOpt, spacingOpt, gapOpt, liveOpt, identityOpt});
+    parser.process(app);
+
+    MockServer::Config c;
+    c.port = quint16(parser.value(portOpt).toUInt());
+    c.latencyMs = parser.value(latencyOpt).toInt();
+    c.bytesPerSec = parser.value(bandwidthOpt).toLongLong();
+    c.chunkSize = parser.value(chunkOpt).toInt();
+    c.errorRate = parser.value(errorOpt).toDouble();
+    c.dropRate = parser.value(dropOpt).toDouble();
+    c.seed = parser.value(seedOpt).toULongLong();
+    c.recordDir = parser.value(recordOpt);
+    c.tipTime = parser.value(tipOpt).toLongLong();
+    c.blockSpacing = parser.value(spacingOpt).toInt();
+    c.gapRate = parser.value(gapOpt).toDouble();
+    c.live = parser.isSet(liveOpt);
+    c.compress = !parser.isSet(identityOpt);
+
+    MockServer server(c);
+    if (!server.start())
+        Fatal("Could not listen on port %d: %s", int(c.port), server.errorString().toUtf8().constData());
+    Log() << "Serving on " << server.baseUrl() << " (tip time " << server.config().tipTime << ")";
+    return app.exec();
+}
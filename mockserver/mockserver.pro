@@ -0,0 +1,14 @@
+# Local stand-in for blockchain.info, see MockServer.h
+
+TEMPLATE = app
+TARGET = mockserver
+INCLUDEPATH += ..
+include(../common.pri)
+
+HEADERS += ../Log.h \
+           ../HttpServer.h \
+           ../MockServer.h
+SOURCES += main.cpp \
+           ../Log.cpp \
+           ../HttpServer.cpp \
+           ../MockServer.cpp